@@ -11,10 +11,43 @@ template <typename Hasher>
 struct external_memory_builder_partitioned_phf {
     typedef Hasher hasher_type;
     typedef typename hasher_type::hash_type hash_type;
-
-    template <typename Iterator>
+    typedef partition_entries<hasher_type> entries_type;
+    typedef typename entries_type::entry_type entry_type;
+
+    /*
+        With the optional positions iterator, positions[i] receives the final position of
+        the i-th key (see build_from_hashes).
+    */
+    template <typename Iterator, typename... PositionsIterator>
     build_timings build_from_keys(Iterator keys, uint64_t num_keys,
-                                  build_configuration const& config) {
+                                  build_configuration const& config,
+                                  PositionsIterator... positions) {
+        build_configuration actual_config = config;
+        if (config.seed == constants::invalid_seed) actual_config.seed = random_value();
+        try {
+            return build_from_hashes(
+                hash_generator<Iterator, hasher_type>(keys, actual_config.seed), num_keys,
+                actual_config, positions...);
+        } catch (seed_runtime_error const& error) {
+            check_distinct_keys<hasher_type>(keys, num_keys, actual_config);
+            throw;
+        }
+    }
+
+    /*
+        The hashes are read once, sequentially (e.g., from a memory-mapped file of
+        hash_type values), and their partition entries (see partition_entries) are spilled
+        to the partition files.
+        With the optional positions iterator, the index of each hash is also spilled
+        (8 more bytes per key), and each partition builder writes the positions of its keys
+        (see internal_memory_builder_single_phf::build_from_hashes): the input is not read again.
+    */
+    template <typename Iterator, typename... PositionsIterator>
+    build_timings build_from_hashes(Iterator hashes, uint64_t num_keys,
+                                    build_configuration const& config,
+                                    PositionsIterator... positions) {
+        static_assert(sizeof...(PositionsIterator) <= 1);
+        constexpr bool with_positions = sizeof...(PositionsIterator) != 0;
         assert(num_keys > 1);
         util::check_hash_collision_probability<Hasher>(num_keys);
 
@@ -22,6 +55,8 @@ struct external_memory_builder_partitioned_phf {
             throw std::invalid_argument("number of partitions must be > 0");
         }
 
+        telemetry_sink* telemetry = config.telemetry;
+        report_phase_start(telemetry, build_phase::partitioning);
         auto start = clock_type::now();
 
         build_timings timings;
@@ -38,6 +73,7 @@ struct external_memory_builder_partitioned_phf {
         m_num_partitions = num_partitions;
         m_bucketer.init(num_partitions);
         m_offsets.resize(num_partitions);
+        m_search_stats.clear();
         m_builders.init(config.tmp_dir,
                         static_cast<uint64_t>(clock_type::now().time_since_epoch().count()),
                         num_partitions);
@@ -49,29 +85,46 @@ struct external_memory_builder_partitioned_phf {
             throw std::runtime_error("average partition size is too small: use less partitions");
         }
         for (uint64_t id = 0; id != num_partitions; ++id) {
-            partitions.emplace_back(config.tmp_dir, id);
+            partitions.emplace_back(config.tmp_dir, id, with_positions);
             partitions.back().reserve(1.5 * average_partition_size);
         }
 
+        auto partition_config = config;
+        partition_config.seed = m_seed;
+        partition_config.num_buckets =
+            static_cast<double>(compute_num_buckets(num_keys, config)) / num_partitions;
+        partition_config.num_threads = 1;
+        partition_config.verbose_output = false;
+
+        entries_type entries;
+        entries.init(partition_config.num_buckets);
+
         size_t bytes = num_partitions * sizeof(meta_partition);
         if (bytes >= config.ram) throw std::runtime_error("not enough RAM available");
 
+        uint64_t index = 0;
         progress_logger logger(num_keys, " == partitioned ", " keys", config.verbose_output);
-        for (uint64_t i = 0; i != num_keys; ++i, ++keys) {
-            auto const& key = *keys;
-            auto hash = hasher_type::hash(key, m_seed);
-            auto b = m_bucketer.bucket(hash.mix());
-            partitions[b].push_back(hash);
-            bytes += sizeof(hash_type);
-            if (bytes >= config.ram) {
-                for (auto& partition : partitions) partition.flush();
-                bytes = num_partitions * sizeof(meta_partition);
-            }
-            logger.log();
-        }
+        transform_hashes(
+            hashes, num_keys, config.num_threads,
+            [&](hash_type const& hash) {
+                return std::make_pair(m_bucketer.bucket(hash.mix()), entries(hash));
+            },
+            [&](std::pair<uint64_t, entry_type> const& partition_entry) {
+                partitions[partition_entry.first].push_back(partition_entry.second, index++);
+                bytes += sizeof(entry_type) + (with_positions ? sizeof(uint64_t) : 0);
+                if (bytes >= config.ram) {
+                    for (auto& partition : partitions) partition.flush();
+                    bytes = num_partitions * sizeof(meta_partition);
+                }
+                logger.log();
+            });
         logger.finalize();
 
-        for (auto& partition : partitions) partition.release();
+        uint64_t partitions_bytes = 0;  // written to the partition files
+        for (auto& partition : partitions) {
+            partition.release();
+            partitions_bytes += partition.bytes_written();
+        }
 
         bool failure = false;
         for (uint64_t i = 0, cumulative_size = 0; i != num_partitions; ++i) {
@@ -90,27 +143,30 @@ struct external_memory_builder_partitioned_phf {
         }
 
         if (failure) {
-            for (uint64_t i = 0; i != num_partitions; ++i) {
-                std::remove(partitions[i].filename().c_str());
-            }
+            for (auto& partition : partitions) partition.remove();
             throw std::runtime_error(
                 "each partition must contain more than one key: use less partitions");
         }
 
-        auto partition_config = config;
-        partition_config.seed = m_seed;
-        uint64_t num_buckets_single_phf = std::ceil((config.c * num_keys) / std::log2(num_keys));
-        partition_config.num_buckets = static_cast<double>(num_buckets_single_phf) / num_partitions;
-        partition_config.num_threads = 1;
-        partition_config.verbose_output = false;
-
         timings.partitioning_seconds += seconds(clock_type::now() - start);
+        telemetry->io(build_phase::partitioning, 0, partitions_bytes);
+        report_phase_end(telemetry, build_phase::partitioning, timings.partitioning_seconds,
+                         partitions_bytes);
+
+        /*
+            The partition files are read back by the mapping of the partitions, and the
+            builders of the partitions are written by their search (and read back by the
+            encoding of the function).
+        */
+        uint64_t partitions_bytes_read = 0;
+        uint64_t builders_bytes_written = 0;
 
         if (config.num_threads > 1) {  // parallel
             start = clock_type::now();
 
             bytes = num_partitions * sizeof(meta_partition);
-            std::vector<std::vector<hash_type>> in_memory_partitions;
+            std::vector<std::vector<entry_type>> in_memory_partitions;
+            std::vector<std::vector<uint64_t>> in_memory_indices;
             uint64_t i = 0;
 
             auto build_partitions = [&]() {
@@ -121,11 +177,28 @@ struct external_memory_builder_partitioned_phf {
                 std::vector<internal_memory_builder_single_phf<hasher_type>> in_memory_builders(
                     in_memory_partitions.size());
                 partition_config.num_partitions = in_memory_partitions.size();
-                auto t = internal_memory_builder_partitioned_phf<hasher_type>::build_partitions(
-                    in_memory_partitions.begin(), in_memory_builders.begin(), partition_config,
-                    config.num_threads);
+                uint64_t first = i - in_memory_partitions.size();
+                build_timings t;
+                if constexpr (with_positions) {
+                    std::vector<subset_positions<PositionsIterator...>> partition_positions;
+                    for (uint64_t j = 0; j != in_memory_indices.size(); ++j) {
+                        partition_positions.emplace_back(positions..., in_memory_indices[j].data(),
+                                                         m_offsets[first + j]);
+                    }
+                    t = internal_memory_builder_partitioned_phf<hasher_type>::build_partitions(
+                        in_memory_partitions.begin(), in_memory_builders.begin(), partition_config,
+                        config.num_threads, first, partition_positions.begin());
+                    in_memory_indices.clear();
+                } else {
+                    t = internal_memory_builder_partitioned_phf<hasher_type>::build_partitions(
+                        in_memory_partitions.begin(), in_memory_builders.begin(), partition_config,
+                        config.num_threads, first);
+                }
                 timings.mapping_ordering_seconds += t.mapping_ordering_seconds;
                 timings.searching_seconds += t.searching_seconds;
+                for (auto const& builder : in_memory_builders) {
+                    m_search_stats.add(builder.search_stats());
+                }
                 in_memory_partitions.clear();
                 bytes = num_partitions * sizeof(meta_partition);
 
@@ -135,7 +208,7 @@ struct external_memory_builder_partitioned_phf {
                 start = clock_type::now();
                 uint64_t id = i - partition_config.num_partitions;
                 for (auto& builder : in_memory_builders) {
-                    m_builders.save(builder, id);
+                    builders_bytes_written += m_builders.save(builder, id);
                     internal_memory_builder_single_phf<hasher_type>().swap(builder);
                     ++id;
                 }
@@ -145,46 +218,66 @@ struct external_memory_builder_partitioned_phf {
 
             for (; i != num_partitions; ++i) {
                 uint64_t size = partitions[i].size();
-                uint64_t partition_bytes = internal_memory_builder_single_phf<
-                    hasher_type>::estimate_num_bytes_for_construction(size, partition_config);
+                uint64_t partition_bytes = internal_memory_builder_single_phf<hasher_type>::
+                    estimate_num_bytes_for_construction(size, partition_config, with_positions);
                 if (bytes + partition_bytes >= config.ram) {
                     timings.partitioning_seconds += seconds(clock_type::now() - start);
                     build_partitions();
                     start = clock_type::now();
                 }
-                std::vector<hash_type> p(size);
-                std::ifstream in(partitions[i].filename().c_str(), std::ifstream::binary);
-                if (!in.is_open()) throw std::runtime_error("cannot open file");
-                in.read(reinterpret_cast<char*>(p.data()),
-                        static_cast<std::streamsize>(size * sizeof(hash_type)));
-                in.close();
-                std::remove(partitions[i].filename().c_str());
-                in_memory_partitions.push_back(std::move(p));
+                in_memory_partitions.push_back(partitions[i].template read<entry_type>(
+                    partitions[i].filename(), partitions_bytes_read));
+                if (with_positions) {
+                    in_memory_indices.push_back(partitions[i].template read<uint64_t>(
+                        partitions[i].indices_filename(), partitions_bytes_read));
+                }
+                partitions[i].remove();
                 bytes += partition_bytes;
             }
             timings.partitioning_seconds += seconds(clock_type::now() - start);
             if (!in_memory_partitions.empty()) build_partitions();
-            std::vector<std::vector<hash_type>>().swap(in_memory_partitions);
+            std::vector<std::vector<entry_type>>().swap(in_memory_partitions);
 
         } else {  // sequential
             internal_memory_builder_single_phf<hasher_type> b;
+            partition_config.telemetry = &noop_telemetry;  // only report whole partitions
             for (uint64_t i = 0; i != num_partitions; ++i) {
                 if (config.verbose_output) {
                     std::cout << "processing partition " << i << "/" << num_partitions
                               << " partitions..." << std::endl;
                 }
-                mm::file_source<hash_type> partition(partitions[i].filename(),
-                                                     mm::advice::sequential);
-                auto t = b.build_from_hashes(partition.data(), partition.size(), partition_config);
+                mm::file_source<entry_type> partition(partitions[i].filename(),
+                                                      mm::advice::sequential);
+                PTHASH_PROBE(spill_read, partition.size() * sizeof(entry_type));
+                partitions_bytes_read += partition.size() * sizeof(entry_type);
+                build_timings t;
+                if constexpr (with_positions) {
+                    mm::file_source<uint64_t> indices(partitions[i].indices_filename(),
+                                                      mm::advice::sequential);
+                    PTHASH_PROBE(spill_read, indices.size() * sizeof(uint64_t));
+                    partitions_bytes_read += indices.size() * sizeof(uint64_t);
+                    t = b.build_from_hashes(
+                        partition.data(), partition.size(), partition_config,
+                        subset_positions<PositionsIterator...>(positions..., indices.data(),
+                                                               m_offsets[i]));
+                    indices.close();
+                } else {
+                    t = b.build_from_hashes(partition.data(), partition.size(), partition_config);
+                }
+                telemetry->partition_done(i, partition.size(), t.mapping_ordering_seconds,
+                                          t.searching_seconds);
+                m_search_stats.add(b.search_stats());
                 partition.close();
                 start = clock_type::now();
-                std::remove(partitions[i].filename().c_str());
-                m_builders.save(b, i);
+                partitions[i].remove();
+                builders_bytes_written += m_builders.save(b, i);
                 timings.partitioning_seconds += seconds(clock_type::now() - start);
                 timings.mapping_ordering_seconds += t.mapping_ordering_seconds;
                 timings.searching_seconds += t.searching_seconds;
             }
         }
+        telemetry->io(build_phase::mapping_ordering, partitions_bytes_read, 0);
+        telemetry->io(build_phase::searching, 0, builders_bytes_written);
 
         return timings;
     }
@@ -234,14 +327,18 @@ private:
             }
         }
 
-        void save(Builder& builder, uint64_t partition) {
-            essentials::save(builder, get_partition_filename(partition).c_str());
+        /* Return the number of bytes written. */
+        uint64_t save(Builder& builder, uint64_t partition) {
+            uint64_t bytes = essentials::save(builder, get_partition_filename(partition).c_str());
+            PTHASH_PROBE(spill_write, bytes);
+            return bytes;
         }
 
         Builder operator[](uint64_t partition) const {
             assert(partition < m_num_partitions);
             Builder builder;
-            essentials::load(builder, get_partition_filename(partition).c_str());
+            uint64_t bytes = essentials::load(builder, get_partition_filename(partition).c_str());
+            PTHASH_PROBE(spill_read, bytes);
             return builder;
         }
 
@@ -268,6 +365,11 @@ public:
         return m_builders;
     }
 
+    /* Statistics of all partitions, empty unless built with config.search_statistics. */
+    search_statistics const& search_stats() const {
+        return m_search_stats;
+    }
+
 private:
     uint64_t m_seed;
     uint64_t m_num_keys;
@@ -276,47 +378,104 @@ private:
     uniform_bucketer m_bucketer;
     std::vector<uint64_t> m_offsets;
     builders_files_manager<internal_memory_builder_single_phf<hasher_type>> m_builders;
+    search_statistics m_search_stats;
 
+    /*
+        The entries of a partition, spilled to a file, and (with_indices) the indices of
+        their hashes, spilled to a second file.
+    */
     struct meta_partition {
-        meta_partition(std::string const& dir_name, uint64_t id)
-            : m_filename(dir_name + "/pthash.temp." + std::to_string(id)), m_size(0) {}
-
-        void push_back(hash_type hash) {
-            m_hashes.push_back(hash);
+        meta_partition(std::string const& dir_name, uint64_t id, bool with_indices)
+            : m_filename(dir_name + "/pthash.temp." + std::to_string(id))
+            , m_with_indices(with_indices)
+            , m_size(0)
+            , m_bytes_written(0) {}
+
+        void push_back(entry_type entry, uint64_t index) {
+            m_entries.push_back(entry);
+            if (m_with_indices) m_indices.push_back(index);
         }
 
         std::string const& filename() const {
             return m_filename;
         }
 
+        std::string indices_filename() const {
+            return m_filename + ".indices";
+        }
+
         void flush() {
-            if (m_hashes.empty()) return;
-            m_size += m_hashes.size();
-            std::ofstream out(m_filename.c_str(), std::ofstream::binary | std::ofstream::app);
-            if (!out.is_open()) throw std::runtime_error("cannot open file");
-            out.write(reinterpret_cast<char const*>(m_hashes.data()),
-                      m_hashes.size() * sizeof(hash_type));
-            out.close();
-            m_hashes.clear();
+            if (m_entries.empty()) return;
+            m_size += m_entries.size();
+            m_bytes_written += append(m_filename, m_entries);
+            m_entries.clear();
+            if (m_with_indices) {
+                m_bytes_written += append(indices_filename(), m_indices);
+                m_indices.clear();
+            }
         }
 
         void reserve(uint64_t n) {
-            m_hashes.reserve(n);
+            m_entries.reserve(n);
+            if (m_with_indices) m_indices.reserve(n);
         }
 
         void release() {
             flush();
-            std::vector<hash_type>().swap(m_hashes);
+            std::vector<entry_type>().swap(m_entries);
+            std::vector<uint64_t>().swap(m_indices);
         }
 
         uint64_t size() const {
             return m_size;
         }
 
+        /* Bytes flushed to the files of the partition so far. */
+        uint64_t bytes_written() const {
+            return m_bytes_written;
+        }
+
+        /* Read back one of the files of the partition, adding the bytes read to bytes_read. */
+        template <typename T>
+        std::vector<T> read(std::string const& filename, uint64_t& bytes_read) const {
+            std::vector<T> data(m_size);
+            std::ifstream in(filename.c_str(), std::ifstream::binary);
+            if (!in.is_open()) throw std::runtime_error("cannot open file");
+            in.read(reinterpret_cast<char*>(data.data()),
+                    static_cast<std::streamsize>(m_size * sizeof(T)));
+            uint64_t bytes = in.gcount();
+            in.close();
+            PTHASH_PROBE(spill_read, bytes);
+            if (bytes != m_size * sizeof(T)) throw std::runtime_error("cannot read file");
+            bytes_read += bytes;
+            return data;
+        }
+
+        void remove() const {
+            std::remove(m_filename.c_str());
+            if (m_with_indices) std::remove(indices_filename().c_str());
+        }
+
     private:
         std::string m_filename;
-        std::vector<hash_type> m_hashes;
+        bool m_with_indices;
+        std::vector<entry_type> m_entries;
+        std::vector<uint64_t> m_indices;
         uint64_t m_size;
+        uint64_t m_bytes_written;
+
+        /* Return the number of bytes written. */
+        template <typename T>
+        static uint64_t append(std::string const& filename, std::vector<T> const& data) {
+            std::ofstream out(filename.c_str(), std::ofstream::binary | std::ofstream::app);
+            if (!out.is_open()) throw std::runtime_error("cannot open file");
+            uint64_t bytes = data.size() * sizeof(T);
+            out.write(reinterpret_cast<char const*>(data.data()), bytes);
+            out.close();
+            if (!out) throw std::runtime_error("cannot write file");
+            PTHASH_PROBE(spill_write, bytes);
+            return bytes;
+        }
     };
 };
 
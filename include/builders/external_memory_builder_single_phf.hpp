@@ -1,5 +1,7 @@
 #pragma once
 
+#include <memory>  // for std::unique_ptr
+
 #include "include/builders/util.hpp"
 #include "include/builders/search.hpp"
 #include "external/mm_file/include/mm_file/mm_file.hpp"
@@ -27,9 +29,90 @@ struct external_memory_builder_single_phf {
         m_free_slots_filename = "";
     }
 
-    template <typename Iterator>
+    /*
+        With the optional positions iterator, positions[i] receives the final position of
+        the i-th key (see build_from_hashes).
+    */
+    template <typename Iterator, typename... PositionsIterator>
     build_timings build_from_keys(Iterator keys, uint64_t num_keys,
-                                  build_configuration const& config) {
+                                  build_configuration const& config,
+                                  PositionsIterator... positions) {
+        build_configuration actual_config = config;
+        if (config.seed == constants::invalid_seed) actual_config.seed = random_value();
+        try {
+            return build_from_hashes(
+                hash_generator<Iterator, hasher_type>(keys, actual_config.seed), num_keys,
+                actual_config, positions...);
+        } catch (seed_runtime_error const& error) {
+            check_distinct_keys<hasher_type>(keys, num_keys, actual_config);
+            throw;
+        }
+    }
+
+    /*
+        The hashes are read once, sequentially (e.g., from a memory-mapped file of
+        hasher_type::hash_type values): config.seed is only used to hash the pilots.
+        The pairs spilled to disk have 32-bit bucket ids unless there are more than
+        2^32 buckets (see wide_bucket_ids).
+        With the optional (random-access) positions iterator, the (bucket id, payload) pair of
+        every hash is also spilled in input order, and read back after the search to write
+        the positions (see write_positions): the input is not read again.
+    */
+    template <typename Iterator, typename... PositionsIterator>
+    build_timings build_from_hashes(Iterator hashes, uint64_t num_keys,
+                                    build_configuration const& config,
+                                    PositionsIterator... positions) {
+        uint64_t num_buckets = compute_num_buckets(num_keys, config);
+        if (wide_bucket_ids(num_buckets)) {
+            return build<uint64_t>(hashes, num_keys, config, positions...);
+        }
+        return build<narrow_bucket_id_type>(hashes, num_keys, config, positions...);
+    }
+
+    uint64_t seed() const {
+        return m_seed;
+    }
+
+    uint64_t num_keys() const {
+        return m_num_keys;
+    }
+
+    uint64_t table_size() const {
+        return m_table_size;
+    }
+
+    skew_bucketer bucketer() const {
+        return m_bucketer;
+    }
+
+    mm::file_source<uint64_t> pilots() const {
+        return mm::file_source<uint64_t>(m_pilots_filename);
+    }
+
+    mm::file_source<uint64_t> free_slots() const {
+        return mm::file_source<uint64_t>(m_free_slots_filename);
+    }
+
+    /* Empty unless built with config.search_statistics. */
+    search_statistics const& search_stats() const {
+        return m_search_stats;
+    }
+
+private:
+    uint64_t m_seed;
+    uint64_t m_num_keys;
+    uint64_t m_table_size;
+    uint64_t m_num_buckets;
+    skew_bucketer m_bucketer;
+    std::string m_pilots_filename;
+    std::string m_free_slots_filename;
+    search_statistics m_search_stats;
+
+    template <typename BucketId, typename Iterator, typename... PositionsIterator>
+    build_timings build(Iterator hashes, uint64_t num_keys, build_configuration const& config,
+                        PositionsIterator... positions) {
+        typedef bucket_payload_pair<BucketId> pair_type;
+        constexpr bool with_positions = sizeof...(PositionsIterator) != 0;
         assert(num_keys > 1);
         util::check_hash_collision_probability<Hasher>(num_keys);
 
@@ -40,16 +123,7 @@ struct external_memory_builder_single_phf {
         build_timings time;
         uint64_t table_size = static_cast<double>(num_keys) / config.alpha;
         if ((table_size & (table_size - 1)) == 0) table_size += 1;
-        uint64_t num_buckets = std::ceil((config.c * num_keys) / std::log2(num_keys));
-
-#ifndef DPTHASH_ENABLE_LARGE_BUCKET_ID_TYPE
-        if (num_buckets >= (1ULL << (sizeof(bucket_id_type) * 8))) {
-            throw std::runtime_error(
-                "using too many buckets: recompile the library with 'cmake .. "
-                "-D PTHASH_ENABLE_LARGE_BUCKET_ID_TYPE=On' to change bucket_id_type to uint64_t or "
-                "use a smaller c");
-        }
-#endif
+        uint64_t num_buckets = compute_num_buckets(num_keys, config);
 
         m_num_keys = num_keys;
         m_table_size = table_size;
@@ -70,8 +144,9 @@ struct external_memory_builder_single_phf {
 
         if (config.verbose_output) {
             constexpr uint64_t GB = 1000000000;
-            uint64_t peak = num_keys * (sizeof(bucket_payload_pair) + sizeof(uint64_t)) +
-                            (num_keys + num_buckets) * sizeof(uint64_t);
+            uint64_t peak = num_keys * (sizeof(pair_type) + sizeof(uint64_t)) +
+                            (num_keys + num_buckets) * sizeof(uint64_t) +
+                            (with_positions ? num_keys * sizeof(pair_type) : 0);
             std::cout << "c = " << config.c << std::endl;
             std::cout << "alpha = " << config.alpha << std::endl;
             std::cout << "num_keys = " << num_keys << std::endl;
@@ -88,13 +163,15 @@ struct external_memory_builder_single_phf {
         temporary_files_manager tfm(config.tmp_dir, run_identifier);
 
         uint64_t num_non_empty_buckets = 0;
+        telemetry_sink* telemetry = config.telemetry;
 
         try {
+            report_phase_start(telemetry, build_phase::mapping_ordering);
             auto start = clock_type::now();
             {
                 auto start = clock_type::now();
-                std::vector<pairs_t> pairs_blocks;
-                map(keys, num_keys, pairs_blocks, tfm, config);
+                std::vector<reader_t<pair_type>> pairs_blocks;
+                map<pair_type>(hashes, num_keys, pairs_blocks, tfm, config, with_positions);
                 auto stop = clock_type::now();
                 if (config.verbose_output) {
                     std::cout << " == map+sort " << tfm.get_num_pairs_files()
@@ -122,14 +199,23 @@ struct external_memory_builder_single_phf {
                 std::cout << " == map+ordering took " << time.mapping_ordering_seconds << " seconds"
                           << std::endl;
             }
+            // each bucket is written to disk as its id followed by its payloads
+            uint64_t buckets_bytes = (num_keys + num_non_empty_buckets) * sizeof(uint64_t);
+            telemetry->io(build_phase::mapping_ordering, tfm.bytes_read(), tfm.bytes_written());
+            report_phase_end(telemetry, build_phase::mapping_ordering,
+                             time.mapping_ordering_seconds, buckets_bytes);
         } catch (...) {
             tfm.remove_all_pairs_files();
             tfm.remove_all_merge_files();
+            tfm.remove_input_pairs_file();
             throw;
         }
 
         try {
+            report_phase_start(telemetry, build_phase::searching);
             auto start = clock_type::now();
+            uint64_t mapping_bytes_read = tfm.bytes_read();
+            uint64_t mapping_bytes_written = tfm.bytes_written();
             bit_vector_builder taken(m_table_size);
 
             {  // search
@@ -137,17 +223,21 @@ struct external_memory_builder_single_phf {
 
                 // write all bucket-pilot pairs to files
                 uint64_t ram_for_pilots = ram - bitmap_taken_bytes - hashed_pilots_cache_bytes;
-                auto pilots =
-                    tfm.get_multifile_pairs_writer(num_non_empty_buckets, ram_for_pilots, 1, 0);
+                auto pilots = tfm.template get_multifile_pairs_writer<pair_type>(
+                    num_non_empty_buckets, ram_for_pilots, 1, 0);
 
+                m_search_stats.clear();
+                if (config.search_statistics) m_search_stats.init();
                 search(m_num_keys, m_num_buckets, num_non_empty_buckets, m_seed, config,
-                       buckets_iterator, taken, pilots);
+                       buckets_iterator, taken, pilots,
+                       config.search_statistics ? &m_search_stats : nullptr);
 
                 pilots.flush();
                 buckets_iterator.close();
                 // merge all sorted bucket-pilot pairs on a single file, saving only the pilot
-                pilots_merger_t pilots_merger(tfm.get_pilots_filename(), ram);
-                merge(tfm.pairs_blocks(), pilots_merger, false);
+                pilots_merger_t pilots_merger(tfm.get_pilots_filename(), ram,
+                                              tfm.bytes_written());
+                merge(tfm.template pairs_blocks<pair_type>(), pilots_merger, false);
                 pilots_merger.finalize_and_close(m_num_buckets);
 
                 if (m_pilots_filename != "") std::remove(m_pilots_filename.c_str());
@@ -158,64 +248,79 @@ struct external_memory_builder_single_phf {
                 tfm.remove_all_merge_files();
             }
 
+            if (m_free_slots_filename != "") std::remove(m_free_slots_filename.c_str());
+            m_free_slots_filename = "";
             if (config.minimal_output and num_keys < table_size) {  // fill free slots
                 // write all free slots to file
                 buffered_file_t<uint64_t> writer(tfm.get_free_slots_filename(),
-                                                 ram - bitmap_taken_bytes);
+                                                 ram - bitmap_taken_bytes, tfm.bytes_written());
                 fill_free_slots(taken, num_keys, writer);
                 writer.close();
-                if (m_free_slots_filename != "") std::remove(m_free_slots_filename.c_str());
                 m_free_slots_filename = tfm.get_free_slots_filename();
             }
 
+            if constexpr (with_positions) {
+                write_positions<pair_type>(tfm.get_input_pairs_filename(), config.num_threads,
+                                           tfm.bytes_read(), positions...);
+                tfm.remove_input_pairs_file();
+            }
+
             auto stop = clock_type::now();
             time.searching_seconds = seconds(stop - start);
             if (config.verbose_output) {
                 std::cout << " == search took " << time.searching_seconds << " seconds"
                           << std::endl;
             }
+            uint64_t pilots_bytes = m_num_buckets * sizeof(uint64_t);
+            uint64_t free_slots_bytes =
+                m_free_slots_filename != "" ? (table_size - num_keys) * sizeof(uint64_t) : 0;
+            telemetry->io(build_phase::searching, tfm.bytes_read() - mapping_bytes_read,
+                          tfm.bytes_written() - mapping_bytes_written);
+            report_phase_end(telemetry, build_phase::searching, time.searching_seconds,
+                             pilots_bytes + free_slots_bytes);
         } catch (...) {
             tfm.remove_all_pairs_files();
             tfm.remove_all_merge_files();
+            tfm.remove_input_pairs_file();
             throw;
         }
 
         return time;
     }
 
-    uint64_t seed() const {
-        return m_seed;
-    }
-
-    uint64_t num_keys() const {
-        return m_num_keys;
-    }
-
-    uint64_t table_size() const {
-        return m_table_size;
-    }
-
-    skew_bucketer bucketer() const {
-        return m_bucketer;
-    }
-
-    mm::file_source<uint64_t> pilots() const {
-        return mm::file_source<uint64_t>(m_pilots_filename);
-    }
-
-    mm::file_source<uint64_t> free_slots() const {
-        return mm::file_source<uint64_t>(m_free_slots_filename);
+    /*
+        Write into positions[i] the final position of the i-th key, from the (bucket id, payload)
+        pairs spilled in input order by map, the pilots and the free slots.
+    */
+    template <typename Pair, typename PositionsIterator>
+    void write_positions(std::string const& filename, uint64_t num_threads, uint64_t& bytes_read,
+                         PositionsIterator positions) const {
+        mm::file_source<Pair> pairs(filename, mm::advice::sequential);
+        if (pairs.size() != m_num_keys) throw std::runtime_error("cannot read temporary file");
+        PTHASH_PROBE(spill_read, pairs.size() * sizeof(Pair));
+        bytes_read += pairs.size() * sizeof(Pair);
+        mm::file_source<uint64_t> pilots(m_pilots_filename, mm::advice::random);
+        mm::file_source<uint64_t> free_slots;
+        if (m_free_slots_filename != "") {
+            free_slots.open(m_free_slots_filename, mm::advice::random);
+        }
+        __uint128_t M = fastmod::computeM_u64(m_table_size);
+        parallel_ranges(m_num_keys, num_threads, [&](uint64_t, uint64_t begin, uint64_t end) {
+            for (; begin != end; ++begin) {
+                Pair pair = pairs.data()[begin];
+                uint64_t hashed_pilot = default_hash64(pilots.data()[pair.bucket_id], m_seed);
+                uint64_t p = fastmod::fastmod_u64(pair.payload ^ hashed_pilot, M, m_table_size);
+                if (p >= m_num_keys and free_slots.is_open()) {
+                    p = free_slots.data()[p - m_num_keys];
+                }
+                positions[begin] = p;
+            }
+        });
+        pairs.close();
+        pilots.close();
+        if (free_slots.is_open()) free_slots.close();
     }
 
-private:
-    uint64_t m_seed;
-    uint64_t m_num_keys;
-    uint64_t m_table_size;
-    uint64_t m_num_buckets;
-    skew_bucketer m_bucketer;
-    std::string m_pilots_filename;
-    std::string m_free_slots_filename;
-
     template <typename T>
     struct buffer_t {
         buffer_t(uint64_t ram) : m_buffer_capacity(ram / sizeof(T)) {
@@ -246,9 +351,11 @@ private:
         std::vector<T> m_buffer;
     };
 
+    /* The bytes written to the file are added to bytes_written. */
     template <typename T>
     struct buffered_file_t : buffer_t<T> {
-        buffered_file_t(std::string const& filename, uint64_t ram) : buffer_t<T>(ram) {
+        buffered_file_t(std::string const& filename, uint64_t ram, uint64_t& bytes_written)
+            : buffer_t<T>(ram), m_bytes_written(bytes_written) {
             m_out.open(filename, std::ofstream::out | std::ofstream::binary);
             if (!m_out.is_open()) throw std::runtime_error("cannot open binary file in write mode");
         }
@@ -260,11 +367,16 @@ private:
 
     protected:
         void flush_impl(std::vector<T>& buffer) {
-            m_out.write(reinterpret_cast<char const*>(buffer.data()), buffer.size() * sizeof(T));
+            uint64_t bytes = buffer.size() * sizeof(T);
+            PTHASH_PROBE(spill_write, bytes);
+            m_out.write(reinterpret_cast<char const*>(buffer.data()), bytes);
+            if (!m_out) throw std::runtime_error("cannot write temporary file");
+            m_bytes_written += bytes;
         }
 
     private:
         std::ofstream m_out;
+        uint64_t& m_bytes_written;
     };
 
     template <typename T>
@@ -294,10 +406,13 @@ private:
 
     template <typename T>
     struct reader_t : memory_view<const T> {
-        void open(std::string const& filename) {
+        /* The file is read once, sequentially: its size is added to bytes_read. */
+        void open(std::string const& filename, uint64_t& bytes_read) {
             if (m_is.is_open()) m_is.close();
             m_is.open(filename, mm::advice::sequential);
             if (!m_is.is_open()) throw std::runtime_error("cannot open temporary file (read)");
+            PTHASH_PROBE(spill_read, m_is.size() * sizeof(T));
+            bytes_read += m_is.size() * sizeof(T);
             memory_view<const T>::m_begin = m_is.data();
             memory_view<const T>::m_end = m_is.data() + m_is.size();
         }
@@ -310,10 +425,10 @@ private:
         mm::file_source<T> m_is;
     };
 
-    typedef reader_t<bucket_payload_pair> pairs_t;
-
+    template <typename Pair>
     struct pairs_merger_t {
-        pairs_merger_t(std::string const& filename, uint64_t ram) : m_buffer(filename, ram) {}
+        pairs_merger_t(std::string const& filename, uint64_t ram, uint64_t& bytes_written)
+            : m_buffer(filename, ram, bytes_written) {}
 
         template <typename HashIterator>
         void add(bucket_id_type bucket_id, bucket_size_type bucket_size, HashIterator hashes) {
@@ -327,19 +442,20 @@ private:
         }
 
     private:
-        buffered_file_t<bucket_payload_pair> m_buffer;
+        buffered_file_t<Pair> m_buffer;
     };
 
     struct buckets_t {  // merger
         buckets_t(std::vector<std::string> const& filenames, uint64_t ram,
-                  std::vector<bool>& used_bucket_sizes)
+                  std::vector<bool>& used_bucket_sizes, uint64_t& bytes_written)
             : m_filenames(filenames)
             , m_buffers(filenames.size())
             , m_buffer_capacity(ram / (sizeof(uint64_t) * 2))
             , m_ram(ram / (sizeof(uint64_t) * 2))
             , m_used_bucket_sizes(used_bucket_sizes)
             , m_outs(filenames.size())
-            , m_num_buckets(0) {
+            , m_num_buckets(0)
+            , m_bytes_written(bytes_written) {
             assert(m_filenames.size() == m_used_bucket_sizes.size());
             m_non_empty_buckets.reserve(filenames.size());
             for (uint64_t i = 0; i != filenames.size(); ++i) {
@@ -395,8 +511,11 @@ private:
                 }
                 m_used_bucket_sizes[i] = true;
             }
-            m_outs[i].write(reinterpret_cast<char const*>(m_buffers[i].data()),
-                            m_buffers[i].size() * sizeof(uint64_t));
+            uint64_t bytes = m_buffers[i].size() * sizeof(uint64_t);
+            PTHASH_PROBE(spill_write, bytes);
+            m_outs[i].write(reinterpret_cast<char const*>(m_buffers[i].data()), bytes);
+            if (!m_outs[i]) throw std::runtime_error("cannot write temporary file");
+            m_bytes_written += bytes;
             m_buffer_capacity += m_buffers[i].size();
             std::vector<uint64_t>().swap(m_buffers[i]);
         }
@@ -409,12 +528,16 @@ private:
         std::vector<bool>& m_used_bucket_sizes;
         std::vector<std::ofstream> m_outs;
         uint64_t m_num_buckets;
+        uint64_t& m_bytes_written;
     };
 
     struct buckets_iterator_t {
         buckets_iterator_t(
-            std::vector<std::pair<bucket_size_type, std::string>> const& sizes_filenames)
-            : m_sizes(sizes_filenames.size()), m_sources(sizes_filenames.size()) {
+            std::vector<std::pair<bucket_size_type, std::string>> const& sizes_filenames,
+            uint64_t& bytes_read)
+            : m_sizes(sizes_filenames.size())
+            , m_sources(sizes_filenames.size())
+            , m_bytes_read(bytes_read) {
             m_pos = sizes_filenames.size();
             for (uint64_t i = 0, i_end = m_pos; i < i_end; ++i) {
                 m_sizes[i] = sizes_filenames[i].first;
@@ -449,6 +572,8 @@ private:
             m_bucket_size = m_sizes[m_pos];
             m_it = m_sources[m_pos].data();
             m_end = m_it + m_sources[m_pos].size();
+            PTHASH_PROBE(spill_read, m_sources[m_pos].size() * sizeof(uint64_t));
+            m_bytes_read += m_sources[m_pos].size() * sizeof(uint64_t);
         }
 
         uint64_t m_pos;
@@ -457,11 +582,12 @@ private:
         bucket_size_type m_bucket_size;
         uint64_t const* m_it;
         uint64_t const* m_end;
+        uint64_t& m_bytes_read;
     };
 
     struct pilots_merger_t {
-        pilots_merger_t(std::string const& filename, uint64_t ram)
-            : m_buffer(filename, ram), m_next_bucket_id(0) {}
+        pilots_merger_t(std::string const& filename, uint64_t ram, uint64_t& bytes_written)
+            : m_buffer(filename, ram, bytes_written), m_next_bucket_id(0) {}
 
         template <typename HashIterator>
         void add(bucket_id_type bucket_id, bucket_size_type bucket_size, HashIterator hashes) {
@@ -487,24 +613,26 @@ private:
         uint64_t m_next_bucket_id;
     };
 
-    struct multifile_pairs_writer : buffer_t<bucket_payload_pair> {
+    template <typename Pair>
+    struct multifile_pairs_writer : buffer_t<Pair> {
         multifile_pairs_writer(std::vector<std::string> const& filenames, uint64_t& num_pairs_files,
-                               uint64_t num_pairs, uint64_t ram, uint64_t num_threads_sort = 1,
-                               uint64_t ram_parallel_merge = 0)
-            : buffer_t<bucket_payload_pair>(get_balanced_ram(num_pairs, ram))
+                               uint64_t& bytes_written, uint64_t num_pairs, uint64_t ram,
+                               uint64_t num_threads_sort = 1, uint64_t ram_parallel_merge = 0)
+            : buffer_t<Pair>(get_balanced_ram(num_pairs, ram))
             , m_filenames(filenames)
             , m_num_pairs_files(num_pairs_files)
+            , m_bytes_written(bytes_written)
             , m_num_threads_sort(num_threads_sort)
             , m_ram_parallel_merge(ram_parallel_merge) {
             assert(num_threads_sort > 1 or ram_parallel_merge == 0);
         }
 
     protected:
-        void flush_impl(std::vector<bucket_payload_pair>& buffer) {
+        void flush_impl(std::vector<Pair>& buffer) {
             const uint64_t size = buffer.size();
 
             if (m_num_threads_sort > 1) {  // parallel
-                std::vector<memory_view<bucket_payload_pair>> blocks;
+                std::vector<memory_view<Pair>> blocks;
                 uint64_t num_keys_per_thread = (size + m_num_threads_sort - 1) / m_num_threads_sort;
                 for (uint64_t i = 0; i != m_num_threads_sort; ++i) {
                     auto begin = buffer.data() + i * num_keys_per_thread;
@@ -525,7 +653,8 @@ private:
                 for (uint64_t i = 0; i != m_num_threads_sort; ++i) {
                     if (threads[i].joinable()) threads[i].join();
                 }
-                pairs_merger_t pairs_merger(m_filenames[m_num_pairs_files], m_ram_parallel_merge);
+                pairs_merger_t<Pair> pairs_merger(m_filenames[m_num_pairs_files],
+                                                  m_ram_parallel_merge, m_bytes_written);
                 ++m_num_pairs_files;
                 merge(blocks, pairs_merger, false);
                 pairs_merger.close();
@@ -535,26 +664,30 @@ private:
                 if (!out.is_open()) throw std::runtime_error("cannot open temporary file (write)");
                 ++m_num_pairs_files;
                 std::sort(buffer.begin(), buffer.end());
+                PTHASH_PROBE(spill_write, size * sizeof(Pair));
                 out.write(reinterpret_cast<char const*>(buffer.data()),
-                          size * sizeof(bucket_payload_pair));
+                          size * sizeof(Pair));
                 out.close();
+                if (!out) throw std::runtime_error("cannot write temporary file");
+                m_bytes_written += size * sizeof(Pair);
             }
         }
 
     private:
         std::vector<std::string> m_filenames;
         uint64_t& m_num_pairs_files;
+        uint64_t& m_bytes_written;
         uint64_t m_num_threads_sort;
         uint64_t m_ram_parallel_merge;
 
         static uint64_t get_balanced_ram(uint64_t num_pairs, uint64_t ram) {
-            uint64_t num_pairs_per_file = ram / sizeof(bucket_payload_pair);
+            uint64_t num_pairs_per_file = ram / sizeof(Pair);
             uint64_t num_temporary_files =
                 (num_pairs + num_pairs_per_file - 1) / num_pairs_per_file;
             uint64_t balanced_num_pairs_per_temporary_file =
                 (num_pairs + num_temporary_files - 1) / num_temporary_files;
             uint64_t balanced_ram =
-                balanced_num_pairs_per_temporary_file * sizeof(bucket_payload_pair);
+                balanced_num_pairs_per_temporary_file * sizeof(Pair);
             assert(balanced_ram <= ram);
 
             return balanced_ram;
@@ -566,14 +699,17 @@ private:
             : m_dir_name(dir_name)
             , m_run_identifier(run_identifier)
             , m_num_pairs_files(0)
-            , m_used_bucket_sizes(MAX_BUCKET_SIZE) {
+            , m_used_bucket_sizes(MAX_BUCKET_SIZE)
+            , m_bytes_read(0)
+            , m_bytes_written(0) {
             std::fill(m_used_bucket_sizes.begin(), m_used_bucket_sizes.end(), false);
         }
 
-        multifile_pairs_writer get_multifile_pairs_writer(uint64_t num_pairs, uint64_t ram,
-                                                          uint64_t num_threads_sort = 1,
-                                                          uint64_t ram_parallel_merge = 0) {
-            uint64_t num_pairs_per_file = ram / sizeof(bucket_payload_pair);
+        template <typename Pair>
+        multifile_pairs_writer<Pair> get_multifile_pairs_writer(uint64_t num_pairs, uint64_t ram,
+                                                                uint64_t num_threads_sort = 1,
+                                                                uint64_t ram_parallel_merge = 0) {
+            uint64_t num_pairs_per_file = ram / sizeof(Pair);
             uint64_t num_temporary_files =
                 (num_pairs + num_pairs_per_file - 1) / num_pairs_per_file;
             std::vector<std::string> filenames;
@@ -581,8 +717,21 @@ private:
             for (uint64_t i = 0; i < num_temporary_files; ++i) {
                 filenames.emplace_back(get_pairs_filename(m_num_pairs_files + i));
             }
-            return multifile_pairs_writer(filenames, m_num_pairs_files, num_pairs, ram,
-                                          num_threads_sort, ram_parallel_merge);
+            return multifile_pairs_writer<Pair>(filenames, m_num_pairs_files, m_bytes_written,
+                                                num_pairs, ram, num_threads_sort,
+                                                ram_parallel_merge);
+        }
+
+        /*
+            Bytes read from and written to the temporary files of the run so far,
+            counted by the readers and writers that the manager creates or that are given them.
+        */
+        uint64_t& bytes_read() {
+            return m_bytes_read;
+        }
+
+        uint64_t& bytes_written() {
+            return m_bytes_written;
         }
 
         uint64_t get_num_pairs_files() const {
@@ -604,9 +753,12 @@ private:
             }
         }
 
-        std::vector<pairs_t> pairs_blocks() const {
-            std::vector<pairs_t> result(m_num_pairs_files);
-            for (uint64_t i = 0; i != m_num_pairs_files; ++i) result[i].open(get_pairs_filename(i));
+        template <typename Pair>
+        std::vector<reader_t<Pair>> pairs_blocks() {
+            std::vector<reader_t<Pair>> result(m_num_pairs_files);
+            for (uint64_t i = 0; i != m_num_pairs_files; ++i) {
+                result[i].open(get_pairs_filename(i), m_bytes_read);
+            }
             return result;
         };
 
@@ -616,7 +768,7 @@ private:
             for (uint64_t bucket_size = 1; bucket_size <= MAX_BUCKET_SIZE; ++bucket_size) {
                 filenames.emplace_back(get_buckets_filename(bucket_size));
             }
-            return buckets_t(filenames, config.ram, m_used_bucket_sizes);
+            return buckets_t(filenames, config.ram, m_used_bucket_sizes, m_bytes_written);
         }
 
         buckets_iterator_t buckets_iterator() {
@@ -628,7 +780,7 @@ private:
                 }
             }
             assert(sizes_filenames.size() > 0);
-            return buckets_iterator_t(sizes_filenames);
+            return buckets_iterator_t(sizes_filenames, m_bytes_read);
         }
 
         bucket_size_type max_bucket_size() {
@@ -646,6 +798,18 @@ private:
             return filename.str();
         }
 
+        /* The (bucket id, payload) pairs of the keys in input order, to write the positions. */
+        std::string get_input_pairs_filename() const {
+            std::stringstream filename;
+            filename << m_dir_name << "/pthash.tmp.run" << m_run_identifier << ".input_pairs"
+                     << ".bin";
+            return filename.str();
+        }
+
+        void remove_input_pairs_file() const {
+            std::remove(get_input_pairs_filename().c_str());
+        }
+
         std::string get_free_slots_filename() const {
             std::stringstream filename;
             filename << m_dir_name << "/pthash.tmp.run" << m_run_identifier << ".free_slots"
@@ -672,11 +836,14 @@ private:
         uint64_t m_run_identifier;
         uint64_t m_num_pairs_files;
         std::vector<bool> m_used_bucket_sizes;
+        uint64_t m_bytes_read;
+        uint64_t m_bytes_written;
     };
 
-    template <typename Iterator>
-    void map(Iterator keys, uint64_t num_keys, std::vector<pairs_t>& pairs_blocks,
-             temporary_files_manager& tfm, build_configuration const& config) {
+    template <typename Pair, typename Iterator>
+    void map(Iterator hashes, uint64_t num_keys, std::vector<reader_t<Pair>>& pairs_blocks,
+             temporary_files_manager& tfm, build_configuration const& config,
+             bool with_positions) {
         progress_logger logger(num_keys, " == processed ", " keys from input",
                                config.verbose_output);
 
@@ -684,24 +851,36 @@ private:
         uint64_t ram_parallel_merge = 0;
         if (config.num_threads > 1) {
             ram_parallel_merge = ram * 0.01;
-            assert(ram_parallel_merge >= MAX_BUCKET_SIZE * sizeof(bucket_payload_pair));
-        }
-
-        auto writer = tfm.get_multifile_pairs_writer(num_keys, ram - ram_parallel_merge,
-                                                     config.num_threads, ram_parallel_merge);
-        try {
-            for (uint64_t i = 0; i != num_keys; ++i, ++keys) {
-                auto const& key = *keys;
-                auto hash = hasher_type::hash(key, m_seed);
-                bucket_id_type bucket_id = m_bucketer.bucket(hash.first());
-                writer.emplace_back(bucket_id, hash.second());
+            assert(ram_parallel_merge >= MAX_BUCKET_SIZE * sizeof(Pair));
+        }
+
+        // with positions, the pairs are also written in input order, through a small buffer
+        uint64_t ram_input_pairs = 0;
+        std::unique_ptr<buffered_file_t<Pair>> input_pairs;
+        if (with_positions) {
+            ram_input_pairs = std::min<uint64_t>(ram / 16, (uint64_t(1) << 20) * sizeof(Pair));
+            input_pairs = std::make_unique<buffered_file_t<Pair>>(
+                tfm.get_input_pairs_filename(), ram_input_pairs, tfm.bytes_written());
+        }
+
+        auto writer = tfm.template get_multifile_pairs_writer<Pair>(
+            num_keys, ram - ram_parallel_merge - ram_input_pairs, config.num_threads,
+            ram_parallel_merge);
+        transform_hashes(
+            hashes, num_keys, config.num_threads,
+            [&](typename hasher_type::hash_type const& hash) {
+                return Pair(m_bucketer.bucket(hash.first()), hash.second());
+            },
+            [&](Pair const& pair) {
+                writer.emplace_back(pair.bucket_id, pair.payload);
+                if (input_pairs) input_pairs->emplace_back(pair);
                 logger.log();
-            }
-            writer.flush();
-            logger.finalize();
-        } catch (std::runtime_error const& e) { throw e; }
+            });
+        writer.flush();
+        if (input_pairs) input_pairs->close();
+        logger.finalize();
 
-        auto tmp = tfm.pairs_blocks();
+        auto tmp = tfm.template pairs_blocks<Pair>();
         pairs_blocks.swap(tmp);
     }
 };
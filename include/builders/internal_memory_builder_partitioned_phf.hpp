@@ -5,22 +5,75 @@
 
 namespace pthash {
 
+/*
+    What the partitioned builders store for each key of a partition. All the partitions of
+    a function have the same number of buckets, so the bucket of a key within its partition
+    can be computed while partitioning: hashes wider than a (bucket id, payload) pair, i.e.,
+    128-bit hashes, are stored as 12-byte pairs, which also spares the partition builders
+    the mapping of the hashes to their buckets. Narrower hashes are stored as they are.
+*/
+template <typename Hasher>
+struct partition_entries {
+    typedef typename Hasher::hash_type hash_type;
+    typedef bucket_payload_pair<narrow_bucket_id_type> pair_type;
+    static constexpr bool compact = sizeof(pair_type) < sizeof(hash_type);
+    typedef std::conditional_t<compact, pair_type, hash_type> entry_type;
+
+    /* num_buckets is the number of buckets of each partition. */
+    void init(uint64_t num_buckets) {
+        if (compact and wide_bucket_ids(num_buckets)) {
+            throw std::runtime_error("too many buckets per partition: use more partitions");
+        }
+        m_bucketer.init(num_buckets);
+    }
+
+    inline entry_type operator()(hash_type const& hash) const {
+        if constexpr (compact) {
+            return pair_type(m_bucketer.bucket(hash.first()), hash.second());
+        } else {
+            return hash;
+        }
+    }
+
+private:
+    skew_bucketer m_bucketer;
+};
+
 template <typename Hasher>
 struct internal_memory_builder_partitioned_phf {
     typedef Hasher hasher_type;
 
-    template <typename Iterator>
+    /*
+        With the optional positions iterator, positions[i] receives the final position of
+        the i-th key (see build_from_hashes).
+    */
+    template <typename Iterator, typename... PositionsIterator>
     build_timings build_from_keys(Iterator keys, uint64_t num_keys,
-                                  build_configuration const& config) {
+                                  build_configuration const& config,
+                                  PositionsIterator... positions) {
         build_configuration actual_config = config;
         if (config.seed == constants::invalid_seed) actual_config.seed = random_value();
-        return build_from_hashes(hash_generator<Iterator, hasher_type>(keys, actual_config.seed),
-                                 num_keys, actual_config);
+        try {
+            return build_from_hashes(
+                hash_generator<Iterator, hasher_type>(keys, actual_config.seed), num_keys,
+                actual_config, positions...);
+        } catch (seed_runtime_error const& error) {
+            check_distinct_keys<hasher_type>(keys, num_keys, actual_config);
+            throw;
+        }
     }
 
-    template <typename Iterator>
+    /*
+        With the optional positions iterator, the index of each hash is stored next to its
+        partition entry (8 more bytes per key), and each partition builder writes the
+        positions of its keys (see internal_memory_builder_single_phf::build_from_hashes).
+    */
+    template <typename Iterator, typename... PositionsIterator>
     build_timings build_from_hashes(Iterator hashes, uint64_t num_keys,
-                                    build_configuration const& config) {
+                                    build_configuration const& config,
+                                    PositionsIterator... positions) {
+        static_assert(sizeof...(PositionsIterator) <= 1);
+        constexpr bool with_positions = sizeof...(PositionsIterator) != 0;
         assert(num_keys > 1);
         util::check_hash_collision_probability<Hasher>(num_keys);
 
@@ -28,6 +81,7 @@ struct internal_memory_builder_partitioned_phf {
             throw std::invalid_argument("number of partitions must be > 0");
         }
 
+        report_phase_start(config.telemetry, build_phase::partitioning);
         auto start = clock_type::now();
 
         build_timings timings;
@@ -46,14 +100,28 @@ struct internal_memory_builder_partitioned_phf {
         if (average_partition_size < constants::min_partition_size and num_partitions > 1) {
             throw std::runtime_error("average partition size is too small: use less partitions");
         }
-        std::vector<std::vector<typename hasher_type::hash_type>> partitions(num_partitions);
+
+        auto partition_config = config;
+        partition_config.seed = m_seed;
+        partition_config.num_buckets =
+            static_cast<double>(compute_num_buckets(num_keys, config)) / num_partitions;
+        partition_config.verbose_output = false;
+        partition_config.num_threads = 1;
+
+        typedef partition_entries<hasher_type> entries_type;
+        entries_type entries;
+        entries.init(partition_config.num_buckets);
+        std::vector<std::vector<typename entries_type::entry_type>> partitions(num_partitions);
         for (auto& partition : partitions) partition.reserve(1.5 * average_partition_size);
+        std::vector<std::vector<uint64_t>> indices(with_positions ? num_partitions : 0);
+        for (auto& partition : indices) partition.reserve(1.5 * average_partition_size);
 
         progress_logger logger(num_keys, " == partitioned ", " keys", config.verbose_output);
         for (uint64_t i = 0; i != num_keys; ++i, ++hashes) {
             auto hash = *hashes;
             auto b = m_bucketer.bucket(hash.mix());
-            partitions[b].push_back(hash);
+            partitions[b].push_back(entries(hash));
+            if (with_positions) indices[b].push_back(i);
             logger.log();
         }
         logger.finalize();
@@ -73,54 +141,77 @@ struct internal_memory_builder_partitioned_phf {
             cumulative_size += config.minimal_output ? partition.size() : table_size;
         }
 
-        auto partition_config = config;
-        partition_config.seed = m_seed;
-        uint64_t num_buckets_single_phf = std::ceil((config.c * num_keys) / std::log2(num_keys));
-        partition_config.num_buckets = static_cast<double>(num_buckets_single_phf) / num_partitions;
-        partition_config.verbose_output = false;
-        partition_config.num_threads = 1;
-
         timings.partitioning_seconds = seconds(clock_type::now() - start);
+        report_phase_end(config.telemetry, build_phase::partitioning, timings.partitioning_seconds,
+                         num_keys * sizeof(typename entries_type::entry_type));
 
-        auto t = build_partitions(partitions.begin(), m_builders.begin(), partition_config,
-                                  config.num_threads);
+        build_timings t;
+        if constexpr (with_positions) {
+            std::vector<subset_positions<PositionsIterator...>> partition_positions;
+            partition_positions.reserve(num_partitions);
+            for (uint64_t i = 0; i != num_partitions; ++i) {
+                partition_positions.emplace_back(positions..., indices[i].data(), m_offsets[i]);
+            }
+            t = build_partitions(partitions.begin(), m_builders.begin(), partition_config,
+                                 config.num_threads, 0, partition_positions.begin());
+        } else {
+            t = build_partitions(partitions.begin(), m_builders.begin(), partition_config,
+                                 config.num_threads);
+        }
         timings.mapping_ordering_seconds = t.mapping_ordering_seconds;
         timings.searching_seconds = t.searching_seconds;
 
+        m_search_stats.clear();
+        for (auto const& builder : m_builders) m_search_stats.add(builder.search_stats());
+
         return timings;
     }
 
-    template <typename PartitionsIterator, typename BuildersIterator>
+    /*
+        Build the partitions [0, config.num_partitions) with num_threads threads.
+        The partitions are reported to config.telemetry with ids starting from
+        first_partition; the builders of the single partitions do not emit events.
+        With the optional positions iterator, positions[i] is the positions iterator
+        of the i-th partition (see subset_positions).
+    */
+    template <typename PartitionsIterator, typename BuildersIterator,
+              typename... PositionsIterator>
     static build_timings build_partitions(PartitionsIterator partitions, BuildersIterator builders,
-                                          build_configuration const& config, uint64_t num_threads) {
+                                          build_configuration const& config, uint64_t num_threads,
+                                          uint64_t first_partition = 0,
+                                          PositionsIterator... positions) {
         build_timings timings;
         uint64_t num_partitions = config.num_partitions;
         assert(config.num_threads == 1);
+        telemetry_sink* telemetry = config.telemetry;
+        build_configuration partition_config = config;
+        partition_config.telemetry = &noop_telemetry;
 
         if (num_threads > 1) {  // parallel
-            std::vector<std::thread> threads(num_threads);
             std::vector<build_timings> thread_timings(num_threads);
+            // e.g., seed_runtime_error: rethrown by the calling thread
+            std::vector<std::exception_ptr> thread_errors(num_threads);
 
             auto exe = [&](uint64_t i, uint64_t begin, uint64_t end) {
-                for (; begin != end; ++begin) {
-                    auto const& partition = partitions[begin];
-                    auto t = builders[begin].build_from_hashes(partition.begin(), partition.size(),
-                                                               config);
-                    thread_timings[i].mapping_ordering_seconds += t.mapping_ordering_seconds;
-                    thread_timings[i].searching_seconds += t.searching_seconds;
+                try {
+                    for (; begin != end; ++begin) {
+                        auto const& partition = partitions[begin];
+                        auto t = builders[begin].build_from_hashes(
+                            partition.begin(), partition.size(), partition_config,
+                            positions[begin]...);
+                        thread_timings[i].mapping_ordering_seconds += t.mapping_ordering_seconds;
+                        thread_timings[i].searching_seconds += t.searching_seconds;
+                        telemetry->partition_done(first_partition + begin, partition.size(),
+                                                  t.mapping_ordering_seconds, t.searching_seconds);
+                    }
+                } catch (...) {
+                    thread_errors[i] = std::current_exception();
                 }
             };
 
-            uint64_t num_partitions_per_thread = (num_partitions + num_threads - 1) / num_threads;
-            for (uint64_t i = 0, begin = 0; i != num_threads; ++i) {
-                uint64_t end = begin + num_partitions_per_thread;
-                if (end > num_partitions) end = num_partitions;
-                threads[i] = std::thread(exe, i, begin, end);
-                begin = end;
-            }
-
-            for (auto& t : threads) {
-                if (t.joinable()) t.join();
+            parallel_ranges(num_partitions, num_threads, exe);
+            for (auto const& error : thread_errors) {
+                if (error) std::rethrow_exception(error);
             }
 
             for (auto const& t : thread_timings) {
@@ -132,9 +223,12 @@ struct internal_memory_builder_partitioned_phf {
         } else {  // sequential
             for (uint64_t i = 0; i != num_partitions; ++i) {
                 auto const& partition = partitions[i];
-                auto t = builders[i].build_from_hashes(partition.begin(), partition.size(), config);
+                auto t = builders[i].build_from_hashes(partition.begin(), partition.size(),
+                                                       partition_config, positions[i]...);
                 timings.mapping_ordering_seconds += t.mapping_ordering_seconds;
                 timings.searching_seconds += t.searching_seconds;
+                telemetry->partition_done(first_partition + i, partition.size(),
+                                          t.mapping_ordering_seconds, t.searching_seconds);
             }
         }
         return timings;
@@ -168,6 +262,44 @@ struct internal_memory_builder_partitioned_phf {
         return m_builders;
     }
 
+    /* Statistics of all partitions, empty unless built with config.search_statistics. */
+    search_statistics const& search_stats() const {
+        return m_search_stats;
+    }
+
+    /*
+        The partition entries, the construction of config.num_threads partitions at a time,
+        and the pilots and free slots of all the partitions built so far.
+        with_positions: if the positions of the keys are requested (see build_from_hashes).
+    */
+    static uint64_t estimate_num_bytes_for_construction(uint64_t num_keys,
+                                                        build_configuration const& config,
+                                                        bool with_positions = false) {
+        typedef internal_memory_builder_single_phf<hasher_type> builder_type;
+        uint64_t num_partitions = std::max<uint64_t>(config.num_partitions, 1);
+        uint64_t partition_size = std::max<uint64_t>(num_keys / num_partitions, 2);
+        uint64_t table_size = static_cast<double>(num_keys) / config.alpha;
+        uint64_t num_buckets = compute_num_buckets(num_keys, config);  // of all partitions
+
+        auto partition_config = config;
+        partition_config.num_buckets = static_cast<double>(num_buckets) / num_partitions;
+
+        // each partition reserves 1.5 times the average partition size
+        uint64_t num_bytes_for_partitions =
+            1.5 * num_keys *
+            (sizeof(typename partition_entries<hasher_type>::entry_type) +
+             (with_positions ? sizeof(uint64_t) : 0));
+        uint64_t num_bytes_for_builders =
+            num_buckets * sizeof(uint64_t)  // pilots
+            + (config.minimal_output ? (table_size - num_keys) * sizeof(uint64_t) : 0);  // free
+        uint64_t num_bytes_for_search =
+            std::min(std::max<uint64_t>(config.num_threads, 1), num_partitions) *
+            builder_type::estimate_num_bytes_for_construction(partition_size, partition_config,
+                                                              with_positions);
+
+        return num_bytes_for_partitions + num_bytes_for_builders + num_bytes_for_search;
+    }
+
 private:
     uint64_t m_seed;
     uint64_t m_num_keys;
@@ -176,6 +308,7 @@ private:
     uniform_bucketer m_bucketer;
     std::vector<uint64_t> m_offsets;
     std::vector<internal_memory_builder_single_phf<hasher_type>> m_builders;
+    search_statistics m_search_stats;
 };
 
 }  // namespace pthash
\ No newline at end of file
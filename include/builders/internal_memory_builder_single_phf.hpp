@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+
 #include "include/builders/util.hpp"
 #include "include/builders/search.hpp"
 #include "include/utils/bucketers.hpp"
@@ -21,30 +23,41 @@ struct internal_memory_builder_single_phf {
         , m_pilots()
         , m_free_slots() {}
 
-    template <typename RandomAccessIterator>
+    /*
+        With the optional positions iterator, positions[i] receives the final position of
+        the i-th key (see build_from_hashes).
+    */
+    template <typename RandomAccessIterator, typename... PositionsIterator>
     build_timings build_from_keys(RandomAccessIterator keys, uint64_t num_keys,
-                                  build_configuration const& config) {
-        if (config.seed == constants::invalid_seed) {
-            build_configuration actual_config = config;
-            for (auto attempt = 0; attempt < 10; ++attempt) {
-                actual_config.seed = random_value();
-                try {
-                    return build_from_hashes(
-                        hash_generator<RandomAccessIterator, hasher_type>(keys, actual_config.seed),
-                        num_keys, actual_config);
-                } catch (seed_runtime_error const& error) {
-                    std::cout << "attempt " << attempt + 1 << " failed" << std::endl;
-                }
-            }
-            throw seed_runtime_error();
-        }
-        return build_from_hashes(
-            hash_generator<RandomAccessIterator, hasher_type>(keys, config.seed), num_keys, config);
+                                  build_configuration const& config,
+                                  PositionsIterator... positions) {
+        return build_with_seed_retries(
+            config,
+            [&](build_configuration const& actual_config) {
+                return build_from_hashes(
+                    hash_generator<RandomAccessIterator, hasher_type>(keys, actual_config.seed),
+                    num_keys, actual_config, positions...);
+            },
+            [&](build_configuration const& actual_config, uint64_t attempt) {
+                if (attempt == 0) check_distinct_keys<hasher_type>(keys, num_keys, actual_config);
+            });
     }
 
-    template <typename RandomAccessIterator>
+    /*
+        The hashes can also be (bucket id, payload) pairs of the keys already mapped to
+        the config.num_buckets buckets, as built by the partitioned builders
+        (see partition_entries).
+        With the optional positions iterator, positions[i] receives the final position of
+        the i-th hash: the search keeps the index of each hash next to its payload, so that
+        the positions are written from the buckets and pilots without reading the hashes
+        again. This takes 8 more bytes per key, and the free slots are filled before the
+        buckets are released.
+    */
+    template <typename RandomAccessIterator, typename... PositionsIterator>
     build_timings build_from_hashes(RandomAccessIterator hashes, uint64_t num_keys,
-                                    build_configuration const& config) {
+                                    build_configuration const& config,
+                                    PositionsIterator... positions) {
+        static_assert(sizeof...(PositionsIterator) <= 1);
         assert(num_keys > 1);
         util::check_hash_collision_probability<Hasher>(num_keys);
 
@@ -52,17 +65,9 @@ struct internal_memory_builder_single_phf {
             throw std::invalid_argument("load factor must be > 0 and <= 1.0");
         }
 
-        clock_type::time_point start;
-
-        start = clock_type::now();
-
-        build_timings time;
-
         uint64_t table_size = static_cast<double>(num_keys) / config.alpha;
         if ((table_size & (table_size - 1)) == 0) table_size += 1;
-        uint64_t num_buckets = (config.num_buckets == constants::invalid_num_buckets)
-                                   ? (std::ceil((config.c * num_keys) / std::log2(num_keys)))
-                                   : config.num_buckets;
+        uint64_t num_buckets = compute_num_buckets(num_keys, config);
 
         m_seed = config.seed;
         m_num_keys = num_keys;
@@ -78,66 +83,8 @@ struct internal_memory_builder_single_phf {
             std::cout << "num_buckets = " << num_buckets << std::endl;
         }
 
-        buckets_t buckets;
-        {
-            auto start = clock_type::now();
-            std::vector<pairs_t> pairs_blocks;
-            map(hashes, num_keys, pairs_blocks, config);
-            auto elapsed = seconds(clock_type::now() - start);
-            if (config.verbose_output) {
-                std::cout << " == map+sort took: " << elapsed << " seconds" << std::endl;
-            }
-
-            start = clock_type::now();
-            merge(pairs_blocks, buckets, config.verbose_output);
-            elapsed = seconds(clock_type::now() - start);
-            if (config.verbose_output) {
-                std::cout << " == merge+check took: " << elapsed << " seconds" << std::endl;
-            }
-        }
-
-        auto buckets_iterator = buckets.begin();
-        time.mapping_ordering_seconds = seconds(clock_type::now() - start);
-        if (config.verbose_output) {
-            std::cout << " == mapping+ordering took " << time.mapping_ordering_seconds
-                      << " seconds " << std::endl;
-            uint64_t max_bucket_size = (*buckets_iterator).size();
-            std::cout << " == max bucket size = " << max_bucket_size << std::endl;
-
-            // avg. bucket size
-            double lambda = std::log2(num_keys) / config.c;
-            // avg. bucket size in first p2=b*m buckets containing p1=a*n keys
-            double lambda_1 = constants::a / constants::b * lambda;
-            // avg. bucket size in the other m-p2=(1-b)*m buckets containing n-p1=(1-a)*n keys
-            double lambda_2 = (1 - constants::a) / (1 - constants::b) * lambda;
-            std::cout << " == lambda = " << lambda << std::endl;
-            std::cout << " == lambda_1 = " << lambda_1 << std::endl;
-            std::cout << " == lambda_2 = " << lambda_2 << std::endl;
-            buckets.print_bucket_size_distribution(max_bucket_size, num_buckets, lambda_1,
-                                                   lambda_2);
-        }
-
-        start = clock_type::now();
-        {
-            m_pilots.resize(num_buckets);
-            std::fill(m_pilots.begin(), m_pilots.end(), 0);
-            bit_vector_builder taken(m_table_size);
-            uint64_t num_non_empty_buckets = buckets.num_buckets();
-            pilots_wrapper_t pilots_wrapper(m_pilots);
-            search(m_num_keys, m_num_buckets, num_non_empty_buckets, m_seed, config,
-                   buckets_iterator, taken, pilots_wrapper);
-            if (config.minimal_output) {
-                m_free_slots.clear();
-                m_free_slots.reserve(taken.size() - num_keys);
-                fill_free_slots(taken, num_keys, m_free_slots);
-            }
-        }
-        time.searching_seconds = seconds(clock_type::now() - start);
-        if (config.verbose_output) {
-            std::cout << " == search took " << time.searching_seconds << " seconds" << std::endl;
-        }
-
-        return time;
+        if (wide_bucket_ids(num_buckets)) return build<uint64_t>(hashes, config, positions...);
+        return build<narrow_bucket_id_type>(hashes, config, positions...);
     }
 
     uint64_t seed() const {
@@ -164,6 +111,11 @@ struct internal_memory_builder_single_phf {
         return m_free_slots;
     }
 
+    /* Empty unless built with config.search_statistics. */
+    search_statistics const& search_stats() const {
+        return m_search_stats;
+    }
+
     void swap(internal_memory_builder_single_phf& other) {
         std::swap(m_seed, other.m_seed);
         std::swap(m_num_keys, other.m_num_keys);
@@ -172,6 +124,7 @@ struct internal_memory_builder_single_phf {
         std::swap(m_bucketer, other.m_bucketer);
         m_pilots.swap(other.m_pilots);
         m_free_slots.swap(other.m_free_slots);
+        std::swap(m_search_stats, other.m_search_stats);
     }
 
     template <typename Visitor>
@@ -185,26 +138,33 @@ struct internal_memory_builder_single_phf {
         visitor.visit(m_free_slots);
     }
 
+    /* with_positions: if the positions of the keys are requested (see build_from_hashes). */
     static uint64_t estimate_num_bytes_for_construction(uint64_t num_keys,
-                                                        build_configuration const& config) {
+                                                        build_configuration const& config,
+                                                        bool with_positions = false) {
         uint64_t table_size = static_cast<double>(num_keys) / config.alpha;
         if ((table_size & (table_size - 1)) == 0) table_size += 1;
-        uint64_t num_buckets = (config.num_buckets == constants::invalid_num_buckets)
-                                   ? (std::ceil((config.c * num_keys) / std::log2(num_keys)))
-                                   : config.num_buckets;
+        uint64_t num_buckets = compute_num_buckets(num_keys, config);
 
-        uint64_t num_bytes_for_map = num_keys * sizeof(bucket_payload_pair)          // pairs
-                                     + (num_keys + num_buckets) * sizeof(uint64_t);  // buckets
+        // payloads, offsets and order of the buckets (see buckets_t)
+        uint64_t num_bytes_for_buckets =
+            num_keys * sizeof(uint64_t) + (num_buckets + 1) * sizeof(uint64_t) +
+            num_buckets * (wide_bucket_ids(num_buckets) ? sizeof(uint64_t)
+                                                        : sizeof(narrow_bucket_id_type)) +
+            (with_positions ? num_keys * sizeof(uint64_t) : 0);  // indices
 
         uint64_t num_bytes_for_search =
-            num_buckets * sizeof(uint64_t)    // pilots
-            + num_buckets * sizeof(uint64_t)  // buckets
-            +
-            (config.minimal_output ? (table_size - num_keys) * sizeof(uint64_t) : 0)  // free_slots
-            + num_keys * sizeof(uint64_t)                                             // hashes
-            + table_size / 8;  // bitmap taken
-
-        return std::max<uint64_t>(num_bytes_for_map, num_bytes_for_search);
+            num_bytes_for_buckets + num_buckets * sizeof(uint64_t)  // pilots
+            + table_size / 8;                                        // bitmap taken
+
+        // the buckets are released before the free slots are filled, unless with_positions
+        uint64_t num_bytes_for_free_slots =
+            num_buckets * sizeof(uint64_t)  // pilots
+            + (config.minimal_output ? (table_size - num_keys) * sizeof(uint64_t) : 0)  // free
+            + table_size / 8  // bitmap taken
+            + (with_positions ? num_bytes_for_buckets : 0);
+
+        return std::max<uint64_t>(num_bytes_for_search, num_bytes_for_free_slots);
     }
 
 private:
@@ -215,70 +175,176 @@ private:
     skew_bucketer m_bucketer;
     std::vector<uint64_t> m_pilots;
     std::vector<uint64_t> m_free_slots;
+    search_statistics m_search_stats;  // not serialized
 
-    typedef std::vector<bucket_payload_pair> pairs_t;
+    template <typename BucketId, typename RandomAccessIterator, typename... PositionsIterator>
+    build_timings build(RandomAccessIterator hashes, build_configuration const& config,
+                        PositionsIterator... positions) {
+        constexpr bool with_positions = sizeof...(PositionsIterator) != 0;
+        clock_type::time_point start;
 
-    struct buckets_iterator_t {
-        buckets_iterator_t(std::vector<std::vector<uint64_t>> const& buffers)
-            : m_buffers_it(buffers.end() - 1), m_bucket_size(buffers.size()) {
-            m_bucket.init(m_buffers_it->data(), m_bucket_size);
-            skip_empty_buckets();
+        start = clock_type::now();
+
+        build_timings time;
+
+        telemetry_sink* telemetry = config.telemetry;
+        report_phase_start(telemetry, build_phase::mapping_ordering);
+
+        buckets_t<BucketId> buckets;
+        buckets.build(hashes, m_num_keys, m_num_buckets, m_bucketer, config, with_positions);
+
+        auto buckets_iterator = buckets.begin();
+        time.mapping_ordering_seconds = seconds(clock_type::now() - start);
+        report_phase_end(telemetry, build_phase::mapping_ordering, time.mapping_ordering_seconds,
+                         buckets.num_bytes());
+        if (config.verbose_output) {
+            std::cout << " == mapping+ordering took " << time.mapping_ordering_seconds
+                      << " seconds " << std::endl;
+            uint64_t max_bucket_size = (*buckets_iterator).size();
+            std::cout << " == max bucket size = " << max_bucket_size << std::endl;
+
+            // avg. bucket size
+            double lambda = std::log2(m_num_keys) / config.c;
+            // avg. bucket size in first p2=b*m buckets containing p1=a*n keys
+            double lambda_1 = constants::a / constants::b * lambda;
+            // avg. bucket size in the other m-p2=(1-b)*m buckets containing n-p1=(1-a)*n keys
+            double lambda_2 = (1 - constants::a) / (1 - constants::b) * lambda;
+            std::cout << " == lambda = " << lambda << std::endl;
+            std::cout << " == lambda_1 = " << lambda_1 << std::endl;
+            std::cout << " == lambda_2 = " << lambda_2 << std::endl;
+            buckets.print_bucket_size_distribution(max_bucket_size, m_num_buckets, lambda_1,
+                                                   lambda_2);
         }
 
-        inline void operator++() {
-            uint64_t const* begin = m_bucket.begin() + m_bucket_size;
-            uint64_t const* end = m_buffers_it->data() + m_buffers_it->size();
-            m_bucket.init(begin, m_bucket_size);
-            if ((m_bucket.begin() - 1) == end and m_bucket_size != 0) {
-                --m_bucket_size;
-                --m_buffers_it;
-                skip_empty_buckets();
+        report_phase_start(telemetry, build_phase::searching);
+        start = clock_type::now();
+        {
+            m_pilots.resize(m_num_buckets);
+            std::fill(m_pilots.begin(), m_pilots.end(), 0);
+            bit_vector_builder taken(m_table_size);
+            uint64_t num_non_empty_buckets = buckets.num_buckets();
+            pilots_wrapper_t pilots_wrapper(m_pilots);
+            m_search_stats.clear();
+            if (config.search_statistics) m_search_stats.init();
+            search(m_num_keys, m_num_buckets, num_non_empty_buckets, m_seed, config,
+                   buckets_iterator, taken, pilots_wrapper,
+                   config.search_statistics ? &m_search_stats : nullptr);
+            // so that the buckets and the free slots never coexist without positions
+            if (!with_positions) buckets.clear();
+            m_free_slots.clear();
+            if (config.minimal_output) {
+                m_free_slots.reserve(taken.size() - m_num_keys);
+                fill_free_slots(taken, m_num_keys, m_free_slots);
+            }
+            if constexpr (with_positions) {
+                write_positions(buckets, config.num_threads, positions...);
+                buckets.clear();
             }
         }
+        time.searching_seconds = seconds(clock_type::now() - start);
+        report_phase_end(telemetry, build_phase::searching, time.searching_seconds,
+                         (m_pilots.size() + m_free_slots.size()) * sizeof(uint64_t));
+        if (config.verbose_output) {
+            std::cout << " == search took " << time.searching_seconds << " seconds" << std::endl;
+        }
+
+        return time;
+    }
+
+    template <typename BucketId>
+    struct buckets_iterator_t {
+        buckets_iterator_t(std::vector<uint64_t> const& offsets,
+                           std::vector<uint64_t> const& payloads,
+                           std::vector<BucketId> const& order)
+            : m_offsets(offsets.data()), m_payloads(payloads.data()), m_order(order.data()) {}
+
+        inline void operator++() {
+            ++m_order;
+        }
 
         inline bucket_t operator*() const {
-            return m_bucket;
+            bucket_t bucket;
+            uint64_t bucket_id = *m_order;
+            uint64_t begin = m_offsets[bucket_id];
+            bucket.init(bucket_id, m_payloads + begin, m_offsets[bucket_id + 1] - begin);
+            return bucket;
         }
 
     private:
-        std::vector<std::vector<uint64_t>>::const_iterator m_buffers_it;
-        bucket_size_type m_bucket_size;
-        bucket_t m_bucket;
-
-        void skip_empty_buckets() {
-            while (m_bucket_size != 0 and m_buffers_it->empty()) {
-                --m_bucket_size;
-                --m_buffers_it;
-            }
-            if (m_bucket_size != 0) m_bucket.init(m_buffers_it->data(), m_bucket_size);
-        }
+        uint64_t const* m_offsets;
+        uint64_t const* m_payloads;
+        BucketId const* m_order;
     };
 
+    /*
+        The payloads of the keys grouped by bucket (sorted within each bucket), the offset
+        of each bucket among them, and the ids of the non-empty buckets in the order of the
+        search: by non-increasing size and, for equal sizes, by increasing id.
+        The payloads are grouped with a counting sort: a first pass over the hashes counts
+        the keys of each bucket and a second pass scatters their payloads, so the hashes are
+        read (or computed, for a hash_generator) twice. As no (bucket id, payload) pair is
+        materialized, this takes 8 bytes per key and 8 + sizeof(BucketId) bytes per bucket,
+        plus 8 bytes per key for the indices of the hashes, kept only with_indices.
+        Caching the pairs of the first pass would take 12 or 16 more bytes per key at the
+        peak to save a hashing pass, that is small next to the random writes of the scatter
+        (on 10M keys of ~40 bytes, 0.25 seconds out of a 2.2-second map).
+    */
+    template <typename BucketId>
     struct buckets_t {
-        buckets_t() : m_buffers(MAX_BUCKET_SIZE), m_num_buckets(0) {}
-
-        template <typename HashIterator>
-        void add(bucket_id_type bucket_id, bucket_size_type bucket_size, HashIterator hashes) {
-            assert(bucket_size > 0);
-            uint64_t i = bucket_size - 1;
-            m_buffers[i].push_back(bucket_id);
-            for (uint64_t k = 0; k != bucket_size; ++k, ++hashes) m_buffers[i].push_back(*hashes);
-            ++m_num_buckets;
+        buckets_t() : m_num_buckets_by_size(MAX_BUCKET_SIZE + 1, 0) {}
+
+        template <typename RandomAccessIterator>
+        void build(RandomAccessIterator hashes, uint64_t num_keys, uint64_t num_buckets,
+                   skew_bucketer const& bucketer, build_configuration const& config,
+                   bool with_indices) {
+            auto start = clock_type::now();
+            map(hashes, num_keys, num_buckets, bucketer, config.num_threads, with_indices);
+            auto elapsed = seconds(clock_type::now() - start);
+            if (config.verbose_output) {
+                std::cout << " == map took: " << elapsed << " seconds" << std::endl;
+            }
+
+            start = clock_type::now();
+            sort(num_buckets, config.num_threads);
+            elapsed = seconds(clock_type::now() - start);
+            if (config.verbose_output) {
+                std::cout << " == sort+check took: " << elapsed << " seconds" << std::endl;
+            }
         }
 
         uint64_t num_buckets() const {
-            return m_num_buckets;
+            return m_order.size();
         };
 
-        buckets_iterator_t begin() const {
-            return buckets_iterator_t(m_buffers);
+        uint64_t num_bytes() const {
+            return (m_offsets.size() + m_payloads.size() + m_indices.size()) * sizeof(uint64_t) +
+                   m_order.size() * sizeof(BucketId);
+        }
+
+        /* Call f(payload, index) for the keys of the bucket (built with_indices). */
+        template <typename Function>
+        void for_each_key(uint64_t bucket_id, Function f) const {
+            assert(!m_indices.empty());
+            for (uint64_t i = m_offsets[bucket_id]; i != m_offsets[bucket_id + 1]; ++i) {
+                f(m_payloads[i], m_indices[i]);
+            }
+        }
+
+        buckets_iterator_t<BucketId> begin() const {
+            return buckets_iterator_t<BucketId>(m_offsets, m_payloads, m_order);
+        }
+
+        void clear() {
+            std::vector<uint64_t>().swap(m_offsets);
+            std::vector<uint64_t>().swap(m_payloads);
+            std::vector<uint64_t>().swap(m_indices);
+            std::vector<BucketId>().swap(m_order);
         }
 
         void print_bucket_size_distribution(uint64_t max_bucket_size, uint64_t num_buckets,
                                             double lambda_1, double lambda_2) {
-            for (int64_t i = max_bucket_size - 1; i >= 0; --i) {
-                uint64_t t = i + 1;
-                uint64_t num_buckets_of_size_t = m_buffers[i].size() / (t + 1);
+            for (uint64_t t = max_bucket_size; t != 0; --t) {
+                uint64_t num_buckets_of_size_t = m_num_buckets_by_size[t];
                 uint64_t estimated_num_buckets_of_size_t =
                     (constants::b * poisson_pmf(t, lambda_1) +
                      (1 - constants::b) * poisson_pmf(t, lambda_2)) *
@@ -290,8 +356,156 @@ private:
         }
 
     private:
-        std::vector<std::vector<uint64_t>> m_buffers;
-        uint64_t m_num_buckets;
+        std::vector<uint64_t> m_offsets;  // num_buckets + 1
+        std::vector<uint64_t> m_payloads;
+        std::vector<uint64_t> m_indices;  // of the hashes, in the order of the payloads
+        std::vector<BucketId> m_order;
+        std::vector<uint64_t> m_num_buckets_by_size;
+
+        template <typename Hash>
+        static inline uint64_t bucket(Hash const& hash, skew_bucketer const& bucketer) {
+            return bucketer.bucket(hash.first());
+        }
+
+        template <typename Hash>
+        static inline uint64_t payload(Hash const& hash) {
+            return hash.second();
+        }
+
+        /* A pair already mapped to its bucket (see partition_entries). */
+        template <typename PairBucketId>
+        static inline uint64_t bucket(bucket_payload_pair<PairBucketId> const& pair,
+                                      skew_bucketer const&) {
+            return pair.bucket_id;
+        }
+
+        template <typename PairBucketId>
+        static inline uint64_t payload(bucket_payload_pair<PairBucketId> const& pair) {
+            return pair.payload;
+        }
+
+        static inline uint64_t increment(uint64_t& counter) {
+            return counter++;
+        }
+
+        static inline uint64_t increment(std::atomic<uint64_t>& counter) {
+            return counter.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        template <typename RandomAccessIterator>
+        void map(RandomAccessIterator hashes, uint64_t num_keys, uint64_t num_buckets,
+                 skew_bucketer const& bucketer, uint64_t num_threads, bool with_indices) {
+            if (num_threads > 1 and num_keys >= num_threads) {
+                // the threads share atomic counters, released before the search
+                std::vector<std::atomic<uint64_t>> counters(num_buckets + 1);
+                map(counters, hashes, num_keys, bucketer, num_threads, with_indices);
+            } else {
+                m_offsets.assign(num_buckets + 1, 0);
+                map(m_offsets, hashes, num_keys, bucketer, 1, with_indices);
+            }
+        }
+
+        /*
+            Group the payloads by bucket with a counting sort over the num_buckets + 1
+            (zero-initialized) counters, which can be m_offsets itself.
+        */
+        template <typename Counters, typename RandomAccessIterator>
+        void map(Counters& counters, RandomAccessIterator hashes, uint64_t num_keys,
+                 skew_bucketer const& bucketer, uint64_t num_threads, bool with_indices) {
+            // count the keys of each bucket: counters[i + 1] is the size of bucket i
+            parallel_ranges(num_keys, num_threads, [&](uint64_t, uint64_t begin, uint64_t end) {
+                RandomAccessIterator it = hashes + begin;
+                for (; begin != end; ++begin, ++it) increment(counters[bucket(*it, bucketer) + 1]);
+            });
+            // counters[i] is the beginning of bucket i
+            for (uint64_t i = 1; i != counters.size(); ++i) {
+                counters[i] = counters[i] + counters[i - 1];
+            }
+
+            // scatter the payloads: counters[i] becomes the end of bucket i
+            m_payloads.resize(num_keys);
+            if (with_indices) m_indices.resize(num_keys);
+            parallel_ranges(num_keys, num_threads, [&](uint64_t, uint64_t begin, uint64_t end) {
+                RandomAccessIterator it = hashes + begin;
+                for (; begin != end; ++begin, ++it) {
+                    auto hash = *it;
+                    uint64_t i = increment(counters[bucket(hash, bucketer)]);
+                    m_payloads[i] = payload(hash);
+                    if (with_indices) m_indices[i] = begin;
+                }
+            });
+
+            // m_offsets[i] is the beginning of bucket i
+            m_offsets.resize(counters.size());
+            for (uint64_t i = counters.size() - 1; i != 0; --i) m_offsets[i] = counters[i - 1];
+            m_offsets.front() = 0;
+        }
+
+        /*
+            Sort the payloads of each bucket, which also makes the result independent of the
+            order in which the threads scattered them, and order the buckets for the search.
+            A bucket with two equal payloads (or too many) fails the seed.
+        */
+        void sort(uint64_t num_buckets, uint64_t num_threads) {
+            std::vector<std::vector<uint64_t>> num_buckets_by_size(
+                std::max<uint64_t>(num_threads, 1), std::vector<uint64_t>(MAX_BUCKET_SIZE + 1, 0));
+            std::atomic<bool> failed(false);
+            auto exe = [&](uint64_t t, uint64_t begin, uint64_t end) {
+                std::vector<std::pair<uint64_t, uint64_t>> keys;  // (payload, index)
+                for (; begin != end; ++begin) {
+                    uint64_t* bucket_begin = m_payloads.data() + m_offsets[begin];
+                    uint64_t* bucket_end = m_payloads.data() + m_offsets[begin + 1];
+                    uint64_t bucket_size = bucket_end - bucket_begin;
+                    if (PTHASH_LIKELY(bucket_size > 1)) {
+                        if (bucket_size > MAX_BUCKET_SIZE) {
+                            failed = true;
+                            return;
+                        }
+                        if (m_indices.empty()) {
+                            std::sort(bucket_begin, bucket_end);
+                        } else {
+                            uint64_t* indices = m_indices.data() + m_offsets[begin];
+                            keys.clear();
+                            for (uint64_t i = 0; i != bucket_size; ++i) {
+                                keys.emplace_back(bucket_begin[i], indices[i]);
+                            }
+                            std::sort(keys.begin(), keys.end());
+                            for (uint64_t i = 0; i != bucket_size; ++i) {
+                                bucket_begin[i] = keys[i].first;
+                                indices[i] = keys[i].second;
+                            }
+                        }
+                        if (std::adjacent_find(bucket_begin, bucket_end) != bucket_end) {
+                            failed = true;
+                            return;
+                        }
+                    }
+                    ++num_buckets_by_size[t][bucket_size];
+                }
+            };
+            parallel_ranges(num_buckets, num_threads, exe);
+            if (failed) throw seed_runtime_error();
+
+            uint64_t num_non_empty_buckets = 0;
+            for (uint64_t size = 1; size <= MAX_BUCKET_SIZE; ++size) {
+                for (auto const& local : num_buckets_by_size) {
+                    m_num_buckets_by_size[size] += local[size];
+                }
+                num_non_empty_buckets += m_num_buckets_by_size[size];
+            }
+
+            // counting sort of the bucket ids by non-increasing size
+            std::vector<uint64_t> next(MAX_BUCKET_SIZE + 1, 0);
+            for (uint64_t size = MAX_BUCKET_SIZE, pos = 0; size != 0; --size) {
+                next[size] = pos;
+                pos += m_num_buckets_by_size[size];
+            }
+            m_order.resize(num_non_empty_buckets);
+            for (uint64_t bucket_id = 0; bucket_id != num_buckets; ++bucket_id) {
+                uint64_t bucket_size = m_offsets[bucket_id + 1] - m_offsets[bucket_id];
+                if (bucket_size != 0) m_order[next[bucket_size]++] = bucket_id;
+            }
+        }
     };
 
     struct pilots_wrapper_t {
@@ -305,58 +519,26 @@ private:
         std::vector<uint64_t>& m_pilots;
     };
 
-    template <typename RandomAccessIterator>
-    void map_sequential(RandomAccessIterator hashes, uint64_t num_keys,
-                        std::vector<pairs_t>& pairs_blocks, build_configuration const&) const {
-        pairs_t pairs(num_keys);
-        RandomAccessIterator begin = hashes;
-        for (uint64_t i = 0; i != num_keys; ++i, ++begin) {
-            auto hash = *begin;
-            auto bucket_id = m_bucketer.bucket(hash.first());
-            pairs[i] = {static_cast<bucket_id_type>(bucket_id), hash.second()};
-        }
-        std::sort(pairs.begin(), pairs.end());
-        pairs_blocks.resize(1);
-        pairs_blocks.front().swap(pairs);
-    }
-
-    template <typename RandomAccessIterator>
-    void map_parallel(RandomAccessIterator hashes, uint64_t num_keys,
-                      std::vector<pairs_t>& pairs_blocks, build_configuration const& config) const {
-        pairs_blocks.resize(config.num_threads);
-        uint64_t num_keys_per_thread = (num_keys + config.num_threads - 1) / config.num_threads;
-
-        auto exe = [&](uint64_t tid) {
-            auto& local_pairs = pairs_blocks[tid];
-            RandomAccessIterator begin = hashes + tid * num_keys_per_thread;
-            uint64_t local_num_keys = (tid != config.num_threads - 1)
-                                          ? num_keys_per_thread
-                                          : (num_keys - tid * num_keys_per_thread);
-            local_pairs.resize(local_num_keys);
-
-            for (uint64_t local_i = 0; local_i != local_num_keys; ++local_i, ++begin) {
-                auto hash = *begin;
-                auto bucket_id = m_bucketer.bucket(hash.first());
-                local_pairs[local_i] = {static_cast<bucket_id_type>(bucket_id), hash.second()};
+    /*
+        Write into positions[i] the final position of the i-th hash, from the payloads and
+        indices of the buckets, with num_threads threads (each on a range of bucket ids).
+    */
+    template <typename BucketId, typename PositionsIterator>
+    void write_positions(buckets_t<BucketId> const& buckets, uint64_t num_threads,
+                         PositionsIterator positions) const {
+        __uint128_t M = fastmod::computeM_u64(m_table_size);
+        parallel_ranges(m_num_buckets, num_threads, [&](uint64_t, uint64_t begin, uint64_t end) {
+            for (; begin != end; ++begin) {
+                uint64_t hashed_pilot = default_hash64(m_pilots[begin], m_seed);
+                buckets.for_each_key(begin, [&](uint64_t payload, uint64_t index) {
+                    uint64_t p = fastmod::fastmod_u64(payload ^ hashed_pilot, M, m_table_size);
+                    if (p >= m_num_keys and !m_free_slots.empty()) {
+                        p = m_free_slots[p - m_num_keys];
+                    }
+                    positions[index] = p;
+                });
             }
-            std::sort(local_pairs.begin(), local_pairs.end());
-        };
-
-        std::vector<std::thread> threads(config.num_threads);
-        for (uint64_t i = 0; i != config.num_threads; ++i) threads[i] = std::thread(exe, i);
-        for (auto& t : threads) {
-            if (t.joinable()) t.join();
-        }
-    }
-
-    template <typename RandomAccessIterator>
-    void map(RandomAccessIterator hashes, uint64_t num_keys, std::vector<pairs_t>& pairs_blocks,
-             build_configuration const& config) const {
-        if (config.num_threads > 1 and num_keys >= config.num_threads) {
-            map_parallel(hashes, num_keys, pairs_blocks, config);
-        } else {
-            map_sequential(hashes, num_keys, pairs_blocks, config);
-        }
+        });
     }
 };
 
@@ -14,9 +14,128 @@ namespace pthash {
 
 constexpr uint64_t search_cache_size = 1000;
 
+/*
+    Statistics of the search, collected when build_configuration::search_statistics is true
+    and returned by the builders with search_stats().
+
+    - pilots_histogram[0] counts the pilots equal to 0 and pilots_histogram[k], for k > 0,
+      the pilots in [2^(k-1), 2^k).
+    - The *_by_size vectors are indexed by bucket size. The time spent on buckets of
+      a given size is exact for the sequential search and approximate for the parallel one.
+    - num_in_bucket_collisions counts the pilots rejected because two keys of the same
+      bucket were mapped to the same position.
+*/
+struct search_statistics {
+    search_statistics() : num_buckets(0), num_trials(0), num_in_bucket_collisions(0) {}
+
+    void init() {
+        num_buckets = 0;
+        num_trials = 0;
+        num_in_bucket_collisions = 0;
+        pilots_histogram.assign(65, 0);
+        num_buckets_by_size.assign(MAX_BUCKET_SIZE + 1, 0);
+        num_trials_by_size.assign(MAX_BUCKET_SIZE + 1, 0);
+        seconds_by_size.assign(MAX_BUCKET_SIZE + 1, 0.0);
+    }
+
+    void clear() {
+        num_buckets = 0;
+        num_trials = 0;
+        num_in_bucket_collisions = 0;
+        std::vector<uint64_t>().swap(pilots_histogram);
+        std::vector<uint64_t>().swap(num_buckets_by_size);
+        std::vector<uint64_t>().swap(num_trials_by_size);
+        std::vector<double>().swap(seconds_by_size);
+    }
+
+    bool empty() const {
+        return pilots_histogram.empty();
+    }
+
+    inline void add_bucket(uint64_t bucket_size, uint64_t pilot, uint64_t in_bucket_collisions) {
+        assert(bucket_size <= MAX_BUCKET_SIZE);
+        uint64_t k = pilot == 0 ? 0 : 64 - __builtin_clzll(pilot);
+        pilots_histogram[k] += 1;
+        num_buckets_by_size[bucket_size] += 1;
+        num_trials_by_size[bucket_size] += pilot + 1;
+        num_buckets += 1;
+        num_trials += pilot + 1;
+        num_in_bucket_collisions += in_bucket_collisions;
+    }
+
+    void add(search_statistics const& other) {
+        if (other.empty()) return;
+        if (empty()) init();
+        num_buckets += other.num_buckets;
+        num_trials += other.num_trials;
+        num_in_bucket_collisions += other.num_in_bucket_collisions;
+        for (uint64_t i = 0; i != pilots_histogram.size(); ++i) {
+            pilots_histogram[i] += other.pilots_histogram[i];
+        }
+        for (uint64_t i = 0; i != num_buckets_by_size.size(); ++i) {
+            num_buckets_by_size[i] += other.num_buckets_by_size[i];
+            num_trials_by_size[i] += other.num_trials_by_size[i];
+            seconds_by_size[i] += other.seconds_by_size[i];
+        }
+    }
+
+    void print() const {
+        std::cout << " == searched buckets = " << num_buckets << std::endl;
+        std::cout << " == trials = " << num_trials << std::endl;
+        std::cout << " == in-bucket collisions = " << num_in_bucket_collisions << std::endl;
+        for (uint64_t k = 0; k != pilots_histogram.size(); ++k) {
+            if (pilots_histogram[k] == 0) continue;
+            std::cout << " == pilots in [" << (k == 0 ? 0 : uint64_t(1) << (k - 1)) << ", "
+                      << (uint64_t(1) << k) << "): " << pilots_histogram[k] << std::endl;
+        }
+        for (uint64_t size = 1; size < num_buckets_by_size.size(); ++size) {
+            if (num_buckets_by_size[size] == 0) continue;
+            std::cout << " == buckets of size " << size << ": " << num_buckets_by_size[size]
+                      << " (" << static_cast<double>(num_trials_by_size[size]) /
+                                     num_buckets_by_size[size]
+                      << " trials per bucket, " << seconds_by_size[size] << " seconds)"
+                      << std::endl;
+        }
+    }
+
+    uint64_t num_buckets;
+    uint64_t num_trials;
+    uint64_t num_in_bucket_collisions;
+    std::vector<uint64_t> pilots_histogram;
+    std::vector<uint64_t> num_buckets_by_size;
+    std::vector<uint64_t> num_trials_by_size;
+    std::vector<double> seconds_by_size;
+};
+
+/* Time spent on consecutive buckets of the same size. */
+struct search_size_class_timer {
+    search_size_class_timer(search_statistics* stats, uint64_t bucket_size)
+        : m_stats(stats), m_bucket_size(bucket_size), m_start(clock_type::now()) {}
+
+    inline void next(uint64_t bucket_size) {
+        if (bucket_size == m_bucket_size) return;
+        auto now = clock_type::now();
+        m_stats->seconds_by_size[m_bucket_size] += seconds(now - m_start);
+        m_bucket_size = bucket_size;
+        m_start = now;
+    }
+
+    void finalize() {
+        m_stats->seconds_by_size[m_bucket_size] += seconds(clock_type::now() - m_start);
+    }
+
+private:
+    search_statistics* m_stats;
+    uint64_t m_bucket_size;
+    clock_type::time_point m_start;
+};
+
 struct search_logger {
-    search_logger(uint64_t num_keys, uint64_t table_size, uint64_t num_buckets)
-        : m_num_keys(num_keys)
+    search_logger(uint64_t num_keys, uint64_t table_size, uint64_t num_buckets,
+                  build_configuration const& config)
+        : m_verbose(config.verbose_output)
+        , m_telemetry(config.telemetry)
+        , m_num_keys(num_keys)
         , m_table_size(table_size)
         , m_num_buckets(num_buckets)
         , m_step(m_num_buckets > 20 ? m_num_buckets / 20 : 1)
@@ -27,8 +146,13 @@ struct search_logger {
         , m_expected_trials(0.0)
         , m_total_expected_trials(0.0) {}
 
+    /* true if either verbose output, telemetry, or a tracer of the search_window probe is on */
+    bool enabled() const {
+        return m_verbose or m_telemetry->enabled() or PTHASH_PROBE_ENABLED(search_window);
+    }
+
     void init() {
-        essentials::logger("search starts");
+        if (m_verbose) essentials::logger("search starts");
         m_timer.start();
     }
 
@@ -67,6 +191,7 @@ struct search_logger {
     void finalize(uint64_t bucket) {
         m_step = bucket - m_bucket;
         print(bucket);
+        if (!m_verbose) return;
         essentials::logger("search ends");
         std::cout << " == " << m_num_buckets - bucket << " empty buckets ("
                   << ((m_num_buckets - bucket) * 100.0) / m_num_buckets << "%)" << std::endl;
@@ -76,6 +201,8 @@ struct search_logger {
     }
 
 private:
+    bool m_verbose;
+    telemetry_sink* m_telemetry;
     uint64_t m_num_keys;
     uint64_t m_table_size;
     uint64_t m_num_buckets;
@@ -88,18 +215,23 @@ private:
     double m_expected_trials;
     double m_total_expected_trials;
 
-    essentials::timer<std::chrono::high_resolution_clock, std::chrono::seconds> m_timer;
+    essentials::timer<std::chrono::high_resolution_clock, std::chrono::milliseconds> m_timer;
 
     void print(uint64_t bucket) {
         m_timer.stop();
-        std::stringbuf buffer;
-        std::ostream os(&buffer);
-        os << m_step << " buckets done in " << m_timer.elapsed() << " seconds ("
-           << (m_placed_keys * 100.0) / m_num_keys << "% of keys, "
-           << (bucket * 100.0) / m_num_buckets << "% of buckets, "
-           << static_cast<double>(m_trials) / m_step << " trials per bucket, "
-           << m_expected_trials / m_step << " expected trials per bucket)";
-        essentials::logger(buffer.str());
+        PTHASH_PROBE(search_window, bucket, m_num_buckets, m_placed_keys, m_trials);
+        m_telemetry->search_window(m_step, bucket, m_num_buckets, m_placed_keys, m_trials,
+                                   m_expected_trials, m_timer.elapsed() / 1000);
+        if (m_verbose) {
+            std::stringbuf buffer;
+            std::ostream os(&buffer);
+            os << m_step << " buckets done in " << m_timer.elapsed() / 1000 << " seconds ("
+               << (m_placed_keys * 100.0) / m_num_keys << "% of keys, "
+               << (bucket * 100.0) / m_num_buckets << "% of buckets, "
+               << static_cast<double>(m_trials) / m_step << " trials per bucket, "
+               << m_expected_trials / m_step << " expected trials per bucket)";
+            essentials::logger(buffer.str());
+        }
         m_bucket = bucket;
         m_trials = 0;
         m_expected_trials = 0.0;
@@ -111,7 +243,7 @@ private:
 template <typename BucketsIterator, typename PilotsBuffer>
 void search_sequential(uint64_t num_keys, uint64_t num_buckets, uint64_t num_non_empty_buckets,
                        uint64_t seed, build_configuration const& config, BucketsIterator& buckets,
-                       bit_vector_builder& taken, PilotsBuffer& pilots) {
+                       bit_vector_builder& taken, PilotsBuffer& pilots, search_statistics* stats) {
     uint64_t max_bucket_size = (*buckets).size();
     uint64_t table_size = taken.size();
     std::vector<uint64_t> positions;
@@ -123,13 +255,18 @@ void search_sequential(uint64_t num_keys, uint64_t num_buckets, uint64_t num_non
         hashed_pilots_cache[pilot] = default_hash64(pilot, seed);
     }
 
-    search_logger log(num_keys, table_size, num_buckets);
-    if (config.verbose_output) log.init();
+    search_logger log(num_keys, table_size, num_buckets, config);
+    bool logging = log.enabled();
+    if (logging) log.init();
+
+    search_size_class_timer size_class_timer(stats, max_bucket_size);
 
     uint64_t processed_buckets = 0;
     for (; processed_buckets < num_non_empty_buckets; ++processed_buckets, ++buckets) {
         auto const& bucket = *buckets;
         assert(bucket.size() > 0);
+        if (stats) size_class_timer.next(bucket.size());
+        uint64_t in_bucket_collisions = 0;
 
         for (uint64_t pilot = 0; true; ++pilot) {
             uint64_t hashed_pilot = PTHASH_LIKELY(pilot < search_cache_size)
@@ -151,27 +288,31 @@ void search_sequential(uint64_t num_keys, uint64_t num_buckets, uint64_t num_non
                 // check for in-bucket collisions
                 std::sort(positions.begin(), positions.end());
                 auto it = std::adjacent_find(positions.begin(), positions.end());
-                if (it != positions.end())
+                if (it != positions.end()) {
+                    ++in_bucket_collisions;
                     continue;  // in-bucket collision detected, try next pilot
+                }
 
                 pilots.emplace_back(bucket.id(), pilot);
                 for (auto p : positions) {
                     assert(taken.get(p) == false);
                     taken.set(p, true);
                 }
-                if (config.verbose_output) log.update(processed_buckets, bucket.size(), pilot);
+                if (logging) log.update(processed_buckets, bucket.size(), pilot);
+                if (stats) stats->add_bucket(bucket.size(), pilot, in_bucket_collisions);
                 break;
             }
         }
     }
 
-    if (config.verbose_output) log.finalize(processed_buckets);
+    if (stats) size_class_timer.finalize();
+    if (logging) log.finalize(processed_buckets);
 }
 
 template <typename BucketsIterator, typename PilotsBuffer>
 void search_parallel(uint64_t num_keys, uint64_t num_buckets, uint64_t num_non_empty_buckets,
                      uint64_t seed, build_configuration const& config, BucketsIterator& buckets,
-                     bit_vector_builder& taken, PilotsBuffer& pilots) {
+                     bit_vector_builder& taken, PilotsBuffer& pilots, search_statistics* stats) {
     uint64_t max_bucket_size = (*buckets).size();
     uint64_t table_size = taken.size();
     __uint128_t M = fastmod::computeM_u64(table_size);
@@ -182,8 +323,12 @@ void search_parallel(uint64_t num_keys, uint64_t num_buckets, uint64_t num_non_e
         hashed_pilots_cache[pilot] = default_hash64(pilot, seed);
     }
 
-    search_logger log(num_keys, table_size, num_buckets);
-    if (config.verbose_output) log.init();
+    search_logger log(num_keys, table_size, num_buckets, config);
+    bool logging = log.enabled();
+    if (logging) log.init();
+
+    // buckets are committed in order: time is attributed to sizes at commit
+    search_size_class_timer size_class_timer(stats, max_bucket_size);
 
     std::atomic<uint64_t> next_bucket_idx = 0;
     static_assert(next_bucket_idx.is_always_lock_free);
@@ -195,6 +340,7 @@ void search_parallel(uint64_t num_keys, uint64_t num_buckets, uint64_t num_non_e
         while (true) {
             uint64_t pilot = 0;
             bool pilot_checked = false;
+            uint64_t in_bucket_collisions = 0;
 
             while (true) {
                 uint64_t local_next_bucket_idx = next_bucket_idx;
@@ -218,7 +364,10 @@ void search_parallel(uint64_t num_keys, uint64_t num_buckets, uint64_t num_non_e
                         if (bucket_begin == bucket_end) {
                             std::sort(positions.begin(), positions.end());
                             auto it = std::adjacent_find(positions.begin(), positions.end());
-                            if (it != positions.end()) continue;
+                            if (it != positions.end()) {
+                                ++in_bucket_collisions;
+                                continue;
+                            }
 
                             // I can stop the pilot search as there are not collisions
                             pilot_checked = true;
@@ -254,7 +403,11 @@ void search_parallel(uint64_t num_keys, uint64_t num_buckets, uint64_t num_non_e
                 assert(taken.get(p) == false);
                 taken.set(p, true);
             }
-            if (config.verbose_output) log.update(local_bucket_idx, bucket.size(), pilot);
+            if (logging) log.update(local_bucket_idx, bucket.size(), pilot);
+            if (stats) {
+                size_class_timer.next(bucket.size());
+                stats->add_bucket(bucket.size(), pilot, in_bucket_collisions);
+            }
 
             // update (local) local_bucket_idx
             local_bucket_idx = next_bucket_idx + num_threads;
@@ -288,13 +441,15 @@ void search_parallel(uint64_t num_keys, uint64_t num_buckets, uint64_t num_non_e
     }
     assert(next_bucket_idx == num_non_empty_buckets);
 
-    if (config.verbose_output) log.finalize(next_bucket_idx);
+    if (stats) size_class_timer.finalize();
+    if (logging) log.finalize(next_bucket_idx);
 }
 
+/* If stats is not null, the statistics of the search are added to *stats (which must be init). */
 template <typename BucketsIterator, typename PilotsBuffer>
 void search(uint64_t num_keys, uint64_t num_buckets, uint64_t num_non_empty_buckets, uint64_t seed,
             build_configuration const& config, BucketsIterator& buckets, bit_vector_builder& taken,
-            PilotsBuffer& pilots) {
+            PilotsBuffer& pilots, search_statistics* stats = nullptr) {
     if (config.num_threads > 1) {
         if (config.num_threads > std::thread::hardware_concurrency()) {
             throw std::invalid_argument("parallel search should use at most " +
@@ -302,10 +457,10 @@ void search(uint64_t num_keys, uint64_t num_buckets, uint64_t num_non_empty_buck
                                         " threads");
         }
         search_parallel(num_keys, num_buckets, num_non_empty_buckets, seed, config, buckets, taken,
-                        pilots);
+                        pilots, stats);
     } else {
         search_sequential(num_keys, num_buckets, num_non_empty_buckets, seed, config, buckets,
-                          taken, pilots);
+                          taken, pilots, stats);
     }
 }
 
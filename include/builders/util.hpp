@@ -1,18 +1,40 @@
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+#include <condition_variable>
+#include <exception>
+#include <limits>
 #include <fstream>
+#include <iterator>
+#include <mutex>
 #include <thread>
 #include <cmath>  // for exp, log, lgamma
 
 #include "include/utils/logger.hpp"
+#include "include/utils/telemetry.hpp"
+#include "include/utils/hasher.hpp"
 
 namespace pthash {
 
-#ifdef DPTHASH_ENABLE_LARGE_BUCKET_ID_TYPE
+/*
+    Bucket ids are 64-bit integers, but in the (bucket id, payload) pairs that the external-memory
+    builders sort and merge, and in the bucket order of the internal-memory builder, they take
+    the narrowest type that fits the number of buckets (see wide_bucket_ids): 32 bits, e.g.,
+    for 12-byte pairs, unless there are more than 2^32 buckets.
+    Compiling with PTHASH_ENABLE_LARGE_BUCKET_ID_TYPE always uses 64-bit ids.
+*/
 typedef uint64_t bucket_id_type;
+#ifdef PTHASH_ENABLE_LARGE_BUCKET_ID_TYPE
+typedef uint64_t narrow_bucket_id_type;
 #else
-typedef uint32_t bucket_id_type;
+typedef uint32_t narrow_bucket_id_type;
 #endif
+
+/* Whether the ids of num_buckets buckets do not fit in a narrow_bucket_id_type. */
+static inline bool wide_bucket_ids(uint64_t num_buckets) {
+    return num_buckets - 1 > std::numeric_limits<narrow_bucket_id_type>::max();
+}
 typedef uint8_t bucket_size_type;
 constexpr bucket_size_type MAX_BUCKET_SIZE = 100;
 
@@ -54,31 +76,109 @@ struct build_configuration {
         , ram(static_cast<double>(constants::available_ram) * 0.75)
         , tmp_dir(constants::default_tmp_dirname)
         , minimal_output(false)
-        , verbose_output(true) {}
+        , verbose_output(true)
+        , search_statistics(false)
+        , telemetry(&noop_telemetry) {}
 
     double c;
     double alpha;
     uint64_t num_partitions;
-    uint64_t num_buckets;
+    uint64_t num_buckets;  // see compute_num_buckets: for partitioned builders, of all partitions
     uint64_t num_threads;
     uint64_t seed;
     uint64_t ram;
     std::string tmp_dir;
     bool minimal_output;
     bool verbose_output;
+    bool search_statistics;     // collect search_stats(), see include/builders/search.hpp
+    telemetry_sink* telemetry;  // not owned
 };
 
+/*
+    The number of buckets for num_keys keys, i.e., config.num_buckets if set, and
+    c * num_keys / log2(num_keys) otherwise (at least 1, also for fewer than two keys).
+    For a partitioned function, this is the total number of buckets of its partitions,
+    which get num_buckets / num_partitions buckets each.
+*/
+static inline uint64_t compute_num_buckets(uint64_t num_keys, build_configuration const& config) {
+    if (config.num_buckets != constants::invalid_num_buckets) return config.num_buckets;
+    if (num_keys < 2) return 1;
+    return std::ceil((config.c * num_keys) / std::log2(num_keys));
+}
+
 struct seed_runtime_error : public std::runtime_error {
     seed_runtime_error() : std::runtime_error("seed did not work") {}
 };
 
+/*
+    Return build(actual_config), where actual_config is config with the seed set.
+    If config.seed is not set, up to 10 random seeds are tried: whenever build throws
+    seed_runtime_error, failed(actual_config, attempt) is called before the next attempt.
+    With config.seed set, failed(config, 0) is called before the error is rethrown.
+*/
+template <typename BuildFunction, typename FailureFunction>
+auto build_with_seed_retries(build_configuration const& config, BuildFunction build,
+                             FailureFunction failed) {
+    if (config.seed != constants::invalid_seed) {
+        try {
+            return build(config);
+        } catch (seed_runtime_error const& error) {
+            failed(config, 0);
+            throw;
+        }
+    }
+    build_configuration actual_config = config;
+    for (uint64_t attempt = 0; attempt != 10; ++attempt) {
+        actual_config.seed = random_value();
+        try {
+            return build(actual_config);
+        } catch (seed_runtime_error const& error) {
+            failed(actual_config, attempt);
+            if (config.verbose_output) {
+                std::cout << "attempt " << attempt + 1 << " failed" << std::endl;
+            }
+        }
+    }
+    throw seed_runtime_error();
+}
+
+/*
+    Thrown by build_from_keys when the keys are not distinct, since no seed can work then.
+    Each duplicate is a pair (i, j): the i-th key is equal to the j-th key, j < i being
+    the first occurrence of the key. The pairs are sorted by i.
+*/
+struct duplicate_keys_error : public std::runtime_error {
+    duplicate_keys_error(std::vector<std::pair<uint64_t, uint64_t>> duplicates)
+        : std::runtime_error(message(duplicates)), m_duplicates(std::move(duplicates)) {}
+
+    std::vector<std::pair<uint64_t, uint64_t>> const& duplicates() const {
+        return m_duplicates;
+    }
+
+private:
+    std::vector<std::pair<uint64_t, uint64_t>> m_duplicates;
+
+    static std::string message(std::vector<std::pair<uint64_t, uint64_t>> const& duplicates) {
+        constexpr uint64_t max_reported = 10;
+        std::stringstream ss;
+        ss << "the input contains " << duplicates.size() << " duplicate keys:";
+        for (uint64_t i = 0; i != std::min<uint64_t>(duplicates.size(), max_reported); ++i) {
+            ss << " key " << duplicates[i].first << " is equal to key " << duplicates[i].second
+               << ";";
+        }
+        if (duplicates.size() > max_reported) ss << " ...";
+        return ss.str();
+    }
+};
+
 #pragma pack(push, 4)
+template <typename BucketId>
 struct bucket_payload_pair {
-    bucket_id_type bucket_id;
+    BucketId bucket_id;
     uint64_t payload;
 
     bucket_payload_pair() {}
-    bucket_payload_pair(bucket_id_type bucket_id, uint64_t payload)
+    bucket_payload_pair(BucketId bucket_id, uint64_t payload)
         : bucket_id(bucket_id), payload(payload) {}
 
     bool operator<(bucket_payload_pair const& other) const {
@@ -88,24 +188,33 @@ struct bucket_payload_pair {
 };
 #pragma pack(pop)
 
+static_assert(sizeof(bucket_payload_pair<uint32_t>) == 12 and
+              sizeof(bucket_payload_pair<uint64_t>) == 16);
+
 struct bucket_t {
-    bucket_t() : m_begin(nullptr), m_size(0) {}
+    bucket_t() : m_id(0), m_begin(nullptr), m_size(0) {}
 
+    /* A bucket stored as its id followed by its payloads. */
     void init(uint64_t const* begin, bucket_size_type size) {
-        m_begin = begin;
+        init(*begin, begin + 1, size);
+    }
+
+    void init(bucket_id_type id, uint64_t const* payloads, bucket_size_type size) {
+        m_id = id;
+        m_begin = payloads;
         m_size = size;
     }
 
     inline bucket_id_type id() const {
-        return *m_begin;
+        return m_id;
     }
 
     inline uint64_t const* begin() const {
-        return m_begin + 1;
+        return m_begin;
     }
 
     inline uint64_t const* end() const {
-        return m_begin + 1 + m_size;
+        return m_begin + m_size;
     }
 
     inline bucket_size_type size() const {
@@ -113,6 +222,7 @@ struct bucket_t {
     }
 
 private:
+    bucket_id_type m_id;
     uint64_t const* m_begin;
     bucket_size_type m_size;
 };
@@ -211,7 +321,7 @@ void merge_multiple_blocks(std::vector<Pairs> const& pairs_blocks, Merger& merge
 
     // read the first pair
     {
-        bucket_payload_pair pair = (*iterators[idx_heap[0]]);
+        auto pair = (*iterators[idx_heap[0]]);
         bucket_id = pair.bucket_id;
         bucket_payloads.push_back(pair.payload);
         advance_heap_head();
@@ -220,7 +330,7 @@ void merge_multiple_blocks(std::vector<Pairs> const& pairs_blocks, Merger& merge
 
     // merge
     for (uint64_t i = 0; (PTHASH_LIKELY(idx_heap.size())); ++i, advance_heap_head()) {
-        bucket_payload_pair pair = (*iterators[idx_heap[0]]);
+        auto pair = (*iterators[idx_heap[0]]);
 
         if (pair.bucket_id == bucket_id) {
             if (PTHASH_LIKELY(pair.payload != bucket_payloads.back())) {
@@ -302,9 +412,355 @@ struct hash_generator {
         return hash_generator(m_iterator + offset, m_seed);
     }
 
+    RandomAccessIterator keys() const {
+        return m_iterator;
+    }
+
+    uint64_t seed() const {
+        return m_seed;
+    }
+
 private:
     RandomAccessIterator m_iterator;
     uint64_t m_seed;
 };
 
+template <typename Iterator>
+struct is_hash_generator : std::false_type {};
+template <typename RandomAccessIterator, typename Hasher>
+struct is_hash_generator<hash_generator<RandomAccessIterator, Hasher>> : std::true_type {};
+
+/* Whether Iterator is a random-access iterator, as the internal-memory builders require. */
+template <typename Iterator, typename = void>
+struct is_random_access_iterator : std::false_type {};
+template <typename Iterator>
+struct is_random_access_iterator<
+    Iterator, std::void_t<typename std::iterator_traits<Iterator>::iterator_category>>
+    : std::is_base_of<std::random_access_iterator_tag,
+                      typename std::iterator_traits<Iterator>::iterator_category> {};
+
+/*
+    Whether the keys of Iterator can be read more than once (from copies of the iterator),
+    i.e., whether it is a forward iterator. Iterators without std::iterator_traits,
+    as the lines iterators of the tools, are taken to be single-pass.
+*/
+template <typename Iterator, typename = void>
+struct is_multi_pass_iterator : std::false_type {};
+template <typename Iterator>
+struct is_multi_pass_iterator<
+    Iterator, std::void_t<typename std::iterator_traits<Iterator>::iterator_category>>
+    : std::is_base_of<std::forward_iterator_tag,
+                      typename std::iterator_traits<Iterator>::iterator_category> {};
+
+/*
+    Call exe(t, begin, end) for the t-th of min(num_threads, n) (about) equal, non-empty ranges
+    [begin, end) of [0, n), each on its own thread; with a single thread, call exe(0, 0, n).
+*/
+template <typename Function>
+void parallel_ranges(uint64_t n, uint64_t num_threads, Function exe) {
+    num_threads = std::min(num_threads, n);
+    if (num_threads <= 1) {
+        exe(0, 0, n);
+        return;
+    }
+    std::vector<std::thread> threads(num_threads);
+    for (uint64_t t = 0, begin = 0; t != num_threads; ++t) {
+        uint64_t end = begin + (n - begin) / (num_threads - t);
+        threads[t] = std::thread(exe, t, begin, end);
+        begin = end;
+    }
+    for (auto& t : threads) {
+        if (t.joinable()) t.join();
+    }
+}
+
+/*
+    The positions of a subset of the keys (e.g., of a partition) within the positions of all
+    the keys: writing p into the i-th position of the subset writes offset + p into
+    positions[indices[i]].
+*/
+template <typename PositionsIterator>
+struct subset_positions {
+    struct reference {
+        inline reference& operator=(uint64_t p) {
+            positions[index] = offset + p;
+            return *this;
+        }
+        PositionsIterator positions;
+        uint64_t index;
+        uint64_t offset;
+    };
+
+    subset_positions(PositionsIterator positions, uint64_t const* indices, uint64_t offset)
+        : m_positions(positions), m_indices(indices), m_offset(offset) {}
+
+    inline reference operator[](uint64_t i) const {
+        return {m_positions, m_indices[i], m_offset};
+    }
+
+private:
+    PositionsIterator m_positions;
+    uint64_t const* m_indices;
+    uint64_t m_offset;
+};
+
+/* See transform_hashes. */
+template <typename RandomAccessIterator, typename Hasher, typename Transform, typename Consume>
+void parallel_transform_hashes(hash_generator<RandomAccessIterator, Hasher> hashes,
+                               uint64_t num_keys, uint64_t num_threads, Transform transform,
+                               Consume consume) {
+    typedef std::decay_t<decltype(*std::declval<RandomAccessIterator&>())> key_type;
+    typedef decltype(transform(std::declval<typename Hasher::hash_type>())) value_type;
+    static constexpr uint64_t block_size = uint64_t(1) << 14;  // keys per thread and round
+
+    RandomAccessIterator keys = hashes.keys();
+    uint64_t seed = hashes.seed();
+    uint64_t round_size = num_threads * block_size;
+    std::vector<key_type> rounds[2] = {std::vector<key_type>(std::min(round_size, num_keys)),
+                                       std::vector<key_type>(std::min(round_size, num_keys))};
+    std::vector<std::vector<value_type>> outputs(num_threads);
+
+    auto read = [&](std::vector<key_type>& round, uint64_t n) {
+        for (uint64_t i = 0; i != n; ++i, ++keys) round[i] = *keys;
+    };
+
+    /*
+        The workers live across the rounds: the calling thread starts round number
+        num_rounds, of n keys in rounds[r], and waits for num_done == num_threads.
+    */
+    std::mutex mutex;
+    std::condition_variable round_started, round_done;
+    uint64_t num_rounds = 0, num_done = 0, n = 0, r = 0;
+    bool stop = false;
+
+    auto worker = [&](uint64_t t) {
+        for (uint64_t seen = 0;; ++seen) {
+            uint64_t round_n, round_r;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                round_started.wait(lock, [&]() { return stop or num_rounds != seen; });
+                if (stop) return;
+                round_n = n;
+                round_r = r;
+            }
+            auto& output = outputs[t];
+            output.clear();
+            uint64_t begin = std::min(t * block_size, round_n);
+            uint64_t end = std::min(begin + block_size, round_n);
+            for (uint64_t i = begin; i != end; ++i) {
+                output.push_back(transform(Hasher::hash(rounds[round_r][i], seed)));
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (++num_done == num_threads) round_done.notify_one();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+    auto join = [&]() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        round_started.notify_all();
+        for (auto& t : threads) t.join();
+    };
+
+    try {
+        for (uint64_t t = 0; t != num_threads; ++t) threads.emplace_back(worker, t);
+        uint64_t next_n = std::min(round_size, num_keys);
+        read(rounds[0], next_n);
+        for (uint64_t processed = 0; next_n != 0; r ^= 1) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                n = next_n;
+                num_done = 0;
+                ++num_rounds;
+            }
+            round_started.notify_all();
+            processed += n;
+            next_n = std::min(round_size, num_keys - processed);
+            read(rounds[r ^ 1], next_n);  // while the threads hash this round
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                round_done.wait(lock, [&]() { return num_done == num_threads; });
+            }
+            for (auto const& output : outputs) {
+                for (auto const& value : output) consume(value);
+            }
+        }
+    } catch (...) {
+        join();
+        throw;
+    }
+    join();
+}
+
+/*
+    Call consume(transform(hash)) for the first num_keys hashes, in input order.
+    consume is always called by the calling thread, transform may be called
+    by any thread.
+
+    When the hashes are generated from keys (hash_generator) and num_threads > 1,
+    the keys are processed in rounds of num_threads * 2^14 keys: num_threads threads,
+    started once for all the rounds, hash and transform the keys of a round into thread-local
+    buffers while the calling thread reads the keys of the next round, then the buffers
+    are consumed in order.
+    Otherwise, the hashes are transformed and consumed one at a time by the calling thread.
+*/
+template <typename Iterator, typename Transform, typename Consume>
+void transform_hashes(Iterator hashes, uint64_t num_keys, uint64_t num_threads,
+                      Transform transform, Consume consume) {
+    if constexpr (is_hash_generator<Iterator>::value) {
+        if (num_threads > 1) {
+            parallel_transform_hashes(hashes, num_keys, num_threads, transform, consume);
+            return;
+        }
+    }
+    for (uint64_t i = 0; i != num_keys; ++i, ++hashes) consume(transform(*hashes));
+}
+
+template <typename Key>
+bool equal_keys(Key const& x, Key const& y) {
+    return x == y;
+}
+
+inline bool equal_keys(byte_range x, byte_range y) {
+    return (x.end - x.begin) == (y.end - y.begin) and
+           std::memcmp(x.begin, y.begin, x.end - x.begin) == 0;
+}
+
+/*
+    Return the duplicates among the first num_keys keys, as described in duplicate_keys_error.
+    The keys are hashed with transform_hashes (hence in parallel with num_threads threads)
+    and the pairs (hash.mix(), index) are scattered by hash into num_threads groups, each sorted
+    by a different thread. Only the (few) keys whose hashes collide are then read again,
+    in a single sequential pass, and compared, so that keys with colliding hashes but
+    different bytes are not reported.
+    The pairs take 16 bytes per key: if they do not fit in half of ram, the hash space is
+    split into slices, handled one at a time, and the keys are hashed once per slice.
+*/
+template <typename Hasher, typename Iterator>
+std::vector<std::pair<uint64_t, uint64_t>> find_duplicate_keys(Iterator keys, uint64_t num_keys,
+                                                               uint64_t seed, uint64_t num_threads,
+                                                               uint64_t ram) {
+    typedef std::pair<uint64_t, uint64_t> hash_index_pair;
+    if (num_threads == 0) num_threads = 1;
+    uint64_t pairs_bytes = 2 * num_keys * sizeof(hash_index_pair);
+    uint64_t num_slices = ram == 0 ? 1 : std::max<uint64_t>((pairs_bytes + ram - 1) / ram, 1);
+
+    /* the indices of the keys with colliding hashes, ending each run with invalid_index */
+    constexpr uint64_t invalid_index = uint64_t(-1);
+    std::vector<std::vector<uint64_t>> candidates(num_threads);
+    std::vector<std::vector<hash_index_pair>> groups(num_threads);
+    for (uint64_t slice = 0; slice != num_slices; ++slice) {
+        for (auto& group : groups) group.reserve(num_keys / (num_slices * num_threads) + 1);
+        uint64_t index = 0;
+        transform_hashes(
+            hash_generator<Iterator, Hasher>(keys, seed), num_keys, num_threads,
+            [](typename Hasher::hash_type const& hash) { return hash.mix(); },
+            [&](uint64_t hash) {
+                if (hash % num_slices == slice) {
+                    groups[(hash / num_slices) % num_threads].emplace_back(hash, index);
+                }
+                ++index;
+            });
+
+        auto exe = [&](uint64_t t) {
+            auto& group = groups[t];
+            std::sort(group.begin(), group.end());
+            for (uint64_t i = 0; i < group.size();) {
+                uint64_t j = i + 1;
+                while (j != group.size() and group[j].first == group[i].first) ++j;
+                if (j - i > 1) {
+                    for (uint64_t k = i; k != j; ++k) candidates[t].push_back(group[k].second);
+                    candidates[t].push_back(invalid_index);
+                }
+                i = j;
+            }
+            std::vector<hash_index_pair>().swap(group);
+        };
+        if (num_threads > 1) {
+            std::vector<std::thread> threads(num_threads);
+            for (uint64_t t = 0; t != num_threads; ++t) threads[t] = std::thread(exe, t);
+            for (auto& t : threads) {
+                if (t.joinable()) t.join();
+            }
+        } else {
+            exe(0);
+        }
+    }
+
+    std::vector<uint64_t> sorted_candidates;
+    for (auto const& c : candidates) {
+        for (uint64_t i : c) {
+            if (i != invalid_index) sorted_candidates.push_back(i);
+        }
+    }
+    std::vector<std::pair<uint64_t, uint64_t>> duplicates;
+    if (sorted_candidates.empty()) return duplicates;
+    std::sort(sorted_candidates.begin(), sorted_candidates.end());
+
+    /* read the candidate keys, in a single pass */
+    typedef std::decay_t<decltype(*std::declval<Iterator&>())> key_type;
+    std::vector<key_type> candidate_keys;
+    candidate_keys.reserve(sorted_candidates.size());
+    {
+        Iterator it = keys;
+        uint64_t next = 0;
+        for (uint64_t i = 0; next != sorted_candidates.size(); ++i, ++it) {
+            key_type key = *it;
+            if (i == sorted_candidates[next]) {
+                candidate_keys.push_back(key);
+                ++next;
+            }
+        }
+    }
+    auto key = [&](uint64_t i) -> key_type const& {
+        auto it = std::lower_bound(sorted_candidates.begin(), sorted_candidates.end(), i);
+        return candidate_keys[it - sorted_candidates.begin()];
+    };
+
+    /* within a run, the indices are increasing: the first equal key is the first occurrence */
+    for (auto const& c : candidates) {
+        for (uint64_t begin = 0, end = 0; begin != c.size(); begin = end + 1) {
+            end = begin;
+            while (c[end] != invalid_index) ++end;
+            for (uint64_t i = begin + 1; i != end; ++i) {
+                for (uint64_t j = begin; j != i; ++j) {
+                    if (equal_keys(key(c[i]), key(c[j]))) {
+                        duplicates.emplace_back(c[i], c[j]);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    std::sort(duplicates.begin(), duplicates.end());
+    return duplicates;
+}
+
+/*
+    Called by build_from_keys when config.seed did not work: keys with the same hash
+    are usually equal keys, for which trying other seeds is useless.
+    Throw duplicate_keys_error if the keys are not distinct. The keys are read again,
+    so single-pass iterators (see is_multi_pass_iterator) are not checked.
+*/
+template <typename Hasher, typename Iterator>
+void check_distinct_keys(Iterator keys, uint64_t num_keys, build_configuration const& config) {
+    if constexpr (is_multi_pass_iterator<Iterator>::value) {
+        if (config.verbose_output) {
+            std::cout << "checking the keys for duplicates..." << std::endl;
+        }
+        auto duplicates = find_duplicate_keys<Hasher>(keys, num_keys, config.seed,
+                                                      config.num_threads, config.ram);
+        if (!duplicates.empty()) throw duplicate_keys_error(std::move(duplicates));
+    } else {
+        if (config.verbose_output) {
+            std::cout << "the keys can be read only once: not checked for duplicates"
+                      << std::endl;
+        }
+    }
+}
+
 }  // namespace pthash
@@ -79,6 +79,13 @@ struct ef_sequence {
         return 8 * (m_high_bits.bytes() + m_high_bits_d1.bytes() + m_low_bits.bytes());
     }
 
+    template <typename Auditor>
+    void audit(Auditor& auditor) const {
+        auditor.add("high_bits", m_high_bits);
+        auditor.add("high_bits_darray", m_high_bits_d1);
+        auditor.add("low_bits", m_low_bits);
+    }
+
     template <typename Visitor>
     void visit(Visitor& visitor) {
         visitor.visit(m_high_bits);
@@ -97,6 +97,14 @@ struct partitioned_compact {
         return m_values.get_bits(position, num_bits);
     }
 
+    template <typename Auditor>
+    void audit(Auditor& auditor) const {
+        auditor.add_bits("size", 8 * sizeof(m_size));
+        auditor.add_bits("bits_per_value",
+                         8 * m_bits_per_value.size() * sizeof(m_bits_per_value.front()));
+        auditor.add("values", m_values);
+    }
+
     template <typename Visitor>
     void visit(Visitor& visitor) {
         visitor.visit(m_size);
@@ -169,6 +177,12 @@ struct dictionary {
         return m_dict.access(rank);
     }
 
+    template <typename Auditor>
+    void audit(Auditor& auditor) const {
+        auditor.add("ranks", m_ranks);
+        auditor.add("dictionary", m_dict);
+    }
+
     template <typename Visitor>
     void visit(Visitor& visitor) {
         visitor.visit(m_ranks);
@@ -203,6 +217,11 @@ struct elias_fano {
         return m_values.diff(i);
     }
 
+    template <typename Auditor>
+    void audit(Auditor& auditor) const {
+        m_values.audit(auditor);
+    }
+
     template <typename Visitor>
     void visit(Visitor& visitor) {
         visitor.visit(m_values);
@@ -237,6 +256,12 @@ struct sdc {
         return m_dict.access(rank);
     }
 
+    template <typename Auditor>
+    void audit(Auditor& auditor) const {
+        auditor.add("ranks", m_ranks);
+        auditor.add("dictionary", m_dict);
+    }
+
     template <typename Visitor>
     void visit(Visitor& visitor) {
         visitor.visit(m_ranks);
@@ -270,6 +295,12 @@ struct dual {
         return m_back.access(i - m_front.size());
     }
 
+    template <typename Auditor>
+    void audit(Auditor& auditor) const {
+        auditor.add("front", m_front);
+        auditor.add("back", m_back);
+    }
+
     template <typename Visitor>
     void visit(Visitor& visitor) {
         visitor.visit(m_front);
@@ -51,6 +51,13 @@ struct sdc_sequence {
         return sizeof(m_size) + m_codewords.bytes() + m_index.num_bits() / 8;
     }
 
+    template <typename Auditor>
+    void audit(Auditor& auditor) const {
+        auditor.add_bits("size", 8 * sizeof(m_size));
+        auditor.add("codewords", m_codewords);
+        auditor.add("index", m_index);
+    }
+
     template <typename Visitor>
     void visit(Visitor& visitor) {
         visitor.visit(m_size);
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <type_traits>
+
+#include "include/builders/util.hpp"
+
+namespace pthash {
+
+/*
+    Several functions (e.g., built over related key sets) can share the same seed and hasher:
+    then, a key needs to be hashed only once to be looked up in all of them.
+
+    build_with_shared_seed calls build(actual_config) where actual_config is config with
+    the seed set: build must construct all the functions with actual_config.
+    If config.seed is not set, random seeds are tried until all the functions build
+    (see build_with_seed_retries). The seed in use is returned.
+*/
+template <typename BuildFunction>
+uint64_t build_with_shared_seed(BuildFunction build, build_configuration const& config) {
+    return build_with_seed_retries(
+        config,
+        [&](build_configuration const& actual_config) {
+            build(actual_config);
+            return actual_config.seed;
+        },
+        [](build_configuration const&, uint64_t) {});
+}
+
+/* Return {functions.position(hash)...}. All functions must have been built with the same seed. */
+template <typename Hash, typename... Functions>
+std::array<uint64_t, sizeof...(Functions)> multi_position(Hash const& hash,
+                                                          Functions const&... functions) {
+    return {functions.position(hash)...};
+}
+
+/* Hash key once and return {functions(key)...}. */
+template <typename T, typename Function, typename... Functions>
+std::array<uint64_t, 1 + sizeof...(Functions)> multi_lookup(T const& key, Function const& f,
+                                                            Functions const&... functions) {
+    typedef typename Function::hasher_type hasher_type;
+    static_assert((std::is_same_v<hasher_type, typename Functions::hasher_type> and ...),
+                  "all functions must use the same hasher");
+    assert(((functions.seed() == f.seed()) and ...));
+    auto hash = hasher_type::hash(key, f.seed());
+    return multi_position(hash, f, functions...);
+}
+
+}  // namespace pthash
@@ -1,10 +1,9 @@
 #pragma once
 
-#include <thread>
-
 #include "include/single_phf.hpp"
 #include "include/builders/internal_memory_builder_partitioned_phf.hpp"
 #include "include/builders/external_memory_builder_partitioned_phf.hpp"
+#include "include/utils/partition_affine_lookup.hpp"
 
 namespace pthash {
 
@@ -12,6 +11,12 @@ template <typename Hasher, typename Encoder, bool Minimal>
 struct partitioned_phf {
 private:
     struct partition {
+        template <typename Auditor>
+        void audit(Auditor& auditor) const {
+            auditor.add_bits("offset", 8 * sizeof(offset));
+            f.audit(auditor);
+        }
+
         template <typename Visitor>
         void visit(Visitor& visitor) {
             visitor.visit(offset);
@@ -23,6 +28,7 @@ private:
     };
 
 public:
+    typedef Hasher hasher_type;
     typedef Encoder encoder_type;
     static constexpr bool minimal = Minimal;
 
@@ -44,8 +50,60 @@ public:
         return timings;
     }
 
+    /*
+        The following two overloads also write into positions[i] the value of f on the i-th key,
+        as computed by the builder from the search results (the keys are not read again).
+    */
+    template <typename Iterator, typename PositionsIterator>
+    build_timings build_in_internal_memory(Iterator keys, uint64_t num_keys,
+                                           build_configuration const& config,
+                                           PositionsIterator positions) {
+        internal_memory_builder_partitioned_phf<Hasher> builder;
+        auto timings = builder.build_from_keys(keys, num_keys, config, positions);
+        timings.encoding_seconds = build(builder, config);
+        return timings;
+    }
+
+    template <typename Iterator, typename PositionsIterator>
+    build_timings build_in_external_memory(Iterator keys, uint64_t num_keys,
+                                           build_configuration const& config,
+                                           PositionsIterator positions) {
+        external_memory_builder_partitioned_phf<Hasher> builder;
+        auto timings = builder.build_from_keys(keys, num_keys, config, positions);
+        timings.encoding_seconds = build(builder, config);
+        return timings;
+    }
+
+    /*
+        Build in internal memory when the keys are random-access and the estimated construction
+        space (internal_memory_builder_partitioned_phf::estimate_num_bytes_for_construction) fits
+        in config.ram, and in external memory otherwise. An internal-memory construction
+        that runs out of memory anyway (std::bad_alloc) is restarted in external memory.
+        As for the overloads above, positions is an optional output iterator.
+    */
+    template <typename Iterator, typename... PositionsIterator>
+    build_timings build(Iterator keys, uint64_t num_keys, build_configuration const& config,
+                        PositionsIterator... positions) {
+        static_assert(sizeof...(PositionsIterator) <= 1);
+        if constexpr (is_random_access_iterator<Iterator>::value) {
+            typedef internal_memory_builder_partitioned_phf<Hasher> internal_builder_type;
+            if (internal_builder_type::estimate_num_bytes_for_construction(
+                    num_keys, config, sizeof...(PositionsIterator) != 0) <= config.ram) {
+                try {
+                    return build_in_internal_memory(keys, num_keys, config, positions...);
+                } catch (std::bad_alloc const&) {
+                    if (config.verbose_output) {
+                        std::cout << "out of memory: building in external memory" << std::endl;
+                    }
+                }
+            }
+        }
+        return build_in_external_memory(keys, num_keys, config, positions...);
+    }
+
     template <typename Builder>
     double build(Builder& builder, build_configuration const& config) {
+        report_phase_start(config.telemetry, build_phase::encoding);
         auto start = clock_type::now();
         if (Minimal && !config.minimal_output) {
             throw std::runtime_error(
@@ -65,35 +123,19 @@ public:
         auto const& offsets = builder.offsets();
         auto const& builders = builder.builders();
         uint64_t num_threads = config.num_threads;
+        build_configuration partition_config = config;
+        partition_config.telemetry = &noop_telemetry;  // report the encoding as a whole
 
-        if (num_threads > 1) {
-            std::vector<std::thread> threads(num_threads);
-            auto exe = [&](uint64_t begin, uint64_t end) {
-                for (; begin != end; ++begin) {
-                    m_partitions[begin].offset = offsets[begin];
-                    m_partitions[begin].f.build(builders[begin], config);
-                }
-            };
-
-            uint64_t num_partitions_per_thread = (num_partitions + num_threads - 1) / num_threads;
-            for (uint64_t t = 0, begin = 0; t != num_threads; ++t) {
-                uint64_t end = begin + num_partitions_per_thread;
-                if (end > num_partitions) end = num_partitions;
-                threads[t] = std::thread(exe, begin, end);
-                begin = end;
-            }
-
-            for (auto& t : threads) {
-                if (t.joinable()) t.join();
+        parallel_ranges(num_partitions, num_threads, [&](uint64_t, uint64_t begin, uint64_t end) {
+            for (; begin != end; ++begin) {
+                m_partitions[begin].offset = offsets[begin];
+                m_partitions[begin].f.build(builders[begin], partition_config);
             }
-        } else {
-            for (uint64_t i = 0; i != num_partitions; ++i) {
-                m_partitions[i].offset = offsets[i];
-                m_partitions[i].f.build(builders[i], config);
-            }
-        }
+        });
 
         auto stop = clock_type::now();
+        report_phase_end(config.telemetry, build_phase::encoding, seconds(stop - start),
+                         (num_bits() + 7) / 8);
         return seconds(stop - start);
     }
 
@@ -103,12 +145,42 @@ public:
         return position(hash);
     }
 
+    /*
+        Write f(keys[i]) into positions[i], for i in [0, num_keys): see bulk_evaluate.
+        The queries are sorted by (partition, bucket).
+    */
+    template <typename RandomAccessIterator, typename PositionsIterator>
+    void evaluate(RandomAccessIterator keys, uint64_t num_keys, PositionsIterator positions,
+                  uint64_t num_threads = 1) const {
+        std::vector<uint64_t> bucket_offsets(m_partitions.size() + 1, 0);
+        for (uint64_t i = 0; i != m_partitions.size(); ++i) {
+            bucket_offsets[i + 1] = bucket_offsets[i] + m_partitions[i].f.num_buckets();
+        }
+        uint64_t num_buckets = bucket_offsets.back();
+        uint64_t shift = bulk_evaluation_shift(num_buckets);
+        bulk_evaluate<Hasher>(
+            *this, keys, num_keys, positions, ((num_buckets - 1) >> shift) + 1,
+            [&](typename Hasher::hash_type const& hash) {
+                auto b = m_bucketer.bucket(hash.mix());
+                return (bucket_offsets[b] + m_partitions[b].f.bucket(hash)) >> shift;
+            },
+            num_threads);
+    }
+
     uint64_t position(typename Hasher::hash_type hash) const {
-        auto b = m_bucketer.bucket(hash.mix());
-        auto const& p = m_partitions[b];
+        return position(hash, partition_id(hash));
+    }
+
+    /* partition must be equal to partition_id(hash) */
+    inline uint64_t position(typename Hasher::hash_type hash, uint64_t partition) const {
+        auto const& p = m_partitions[partition];
         return p.offset + p.f.position(hash);
     }
 
+    inline uint64_t partition_id(typename Hasher::hash_type hash) const {
+        return m_bucketer.bucket(hash.mix());
+    }
+
     size_t num_bits_for_pilots() const {
         size_t bits = 8 * (sizeof(m_seed) + sizeof(m_num_keys) + sizeof(m_table_size) +
                            sizeof(size_t)  // for std::vector::size
@@ -128,6 +200,10 @@ public:
         return num_bits_for_pilots() + num_bits_for_mapper();
     }
 
+    inline uint64_t num_partitions() const {
+        return m_partitions.size();
+    }
+
     inline uint64_t num_keys() const {
         return m_num_keys;
     }
@@ -140,6 +216,24 @@ public:
         return m_seed;
     }
 
+    /* The function of the i-th partition: its values are relative to partition_offset(i). */
+    inline single_phf<Hasher, Encoder, Minimal> const& partition_function(uint64_t i) const {
+        return m_partitions[i].f;
+    }
+
+    inline uint64_t partition_offset(uint64_t i) const {
+        return m_partitions[i].offset;
+    }
+
+    /* Space breakdown: see space_auditor. The partitions are summed together. */
+    template <typename Auditor>
+    void audit(Auditor& auditor) const {
+        auditor.add_bits("parameters", 8 * (sizeof(m_seed) + sizeof(m_num_keys) +
+                                            sizeof(m_table_size) + sizeof(size_t)));
+        auditor.add("bucketer", m_bucketer);
+        for (auto const& p : m_partitions) auditor.add("partitions", p);
+    }
+
     template <typename Visitor>
     void visit(Visitor& visitor) {
         visitor.visit(m_seed);
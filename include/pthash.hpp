@@ -2,4 +2,6 @@
 
 #include "include/encoders/encoders.hpp"
 #include "include/single_phf.hpp"
-#include "include/partitioned_phf.hpp"
\ No newline at end of file
+#include "include/partitioned_phf.hpp"
+#include "include/multi_position.hpp"
+#include "include/utils/space_audit.hpp"
\ No newline at end of file
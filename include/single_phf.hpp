@@ -1,6 +1,7 @@
 #pragma once
 
 #include "include/utils/bucketers.hpp"
+#include "include/utils/bulk_evaluation.hpp"
 #include "include/builders/util.hpp"
 #include "include/builders/internal_memory_builder_single_phf.hpp"
 #include "include/builders/external_memory_builder_single_phf.hpp"
@@ -9,6 +10,7 @@ namespace pthash {
 
 template <typename Hasher, typename Encoder, bool Minimal>
 struct single_phf {
+    typedef Hasher hasher_type;
     typedef Encoder encoder_type;
     static constexpr bool minimal = Minimal;
 
@@ -30,8 +32,60 @@ struct single_phf {
         return timings;
     }
 
+    /*
+        The following two overloads also write into positions[i] the value of f on the i-th key,
+        as computed by the builder from the search results: the keys are not read again.
+    */
+    template <typename Iterator, typename PositionsIterator>
+    build_timings build_in_internal_memory(Iterator keys, uint64_t n,
+                                           build_configuration const& config,
+                                           PositionsIterator positions) {
+        internal_memory_builder_single_phf<Hasher> builder;
+        auto timings = builder.build_from_keys(keys, n, config, positions);
+        timings.encoding_seconds = build(builder, config);
+        return timings;
+    }
+
+    template <typename Iterator, typename PositionsIterator>
+    build_timings build_in_external_memory(Iterator keys, uint64_t n,
+                                           build_configuration const& config,
+                                           PositionsIterator positions) {
+        external_memory_builder_single_phf<Hasher> builder;
+        auto timings = builder.build_from_keys(keys, n, config, positions);
+        timings.encoding_seconds = build(builder, config);
+        return timings;
+    }
+
+    /*
+        Build in internal memory when the keys are random-access and the estimated construction
+        space (internal_memory_builder_single_phf::estimate_num_bytes_for_construction) fits
+        in config.ram, and in external memory otherwise. An internal-memory construction
+        that runs out of memory anyway (std::bad_alloc) is restarted in external memory.
+        As for the overloads above, positions is an optional output iterator.
+    */
+    template <typename Iterator, typename... PositionsIterator>
+    build_timings build(Iterator keys, uint64_t n, build_configuration const& config,
+                        PositionsIterator... positions) {
+        static_assert(sizeof...(PositionsIterator) <= 1);
+        if constexpr (is_random_access_iterator<Iterator>::value) {
+            typedef internal_memory_builder_single_phf<Hasher> internal_builder_type;
+            if (internal_builder_type::estimate_num_bytes_for_construction(
+                    n, config, sizeof...(PositionsIterator) != 0) <= config.ram) {
+                try {
+                    return build_in_internal_memory(keys, n, config, positions...);
+                } catch (std::bad_alloc const&) {
+                    if (config.verbose_output) {
+                        std::cout << "out of memory: building in external memory" << std::endl;
+                    }
+                }
+            }
+        }
+        return build_in_external_memory(keys, n, config, positions...);
+    }
+
     template <typename Builder>
     double build(Builder const& builder, build_configuration const& config) {
+        report_phase_start(config.telemetry, build_phase::encoding);
         auto start = clock_type::now();
         if (Minimal && !config.minimal_output) {
             throw std::runtime_error(
@@ -50,6 +104,8 @@ struct single_phf {
             m_free_slots.encode(builder.free_slots().data(), m_table_size - m_num_keys);
         }
         auto stop = clock_type::now();
+        report_phase_end(config.telemetry, build_phase::encoding, seconds(stop - start),
+                         (num_bits() + 7) / 8);
         return seconds(stop - start);
     }
 
@@ -59,6 +115,17 @@ struct single_phf {
         return position(hash);
     }
 
+    /* Write f(keys[i]) into positions[i], for i in [0, num_keys): see bulk_evaluate. */
+    template <typename RandomAccessIterator, typename PositionsIterator>
+    void evaluate(RandomAccessIterator keys, uint64_t num_keys, PositionsIterator positions,
+                  uint64_t num_threads = 1) const {
+        uint64_t shift = bulk_evaluation_shift(num_buckets());
+        bulk_evaluate<Hasher>(
+            *this, keys, num_keys, positions, ((num_buckets() - 1) >> shift) + 1,
+            [&](typename Hasher::hash_type const& hash) { return bucket(hash) >> shift; },
+            num_threads);
+    }
+
     uint64_t position(typename Hasher::hash_type hash) const {
         uint64_t bucket = m_bucketer.bucket(hash.first());
         uint64_t pilot = m_pilots.access(bucket);
@@ -84,6 +151,14 @@ struct single_phf {
         return num_bits_for_pilots() + num_bits_for_mapper();
     }
 
+    inline uint64_t bucket(typename Hasher::hash_type hash) const {
+        return m_bucketer.bucket(hash.first());
+    }
+
+    inline uint64_t num_buckets() const {
+        return m_bucketer.num_buckets();
+    }
+
     inline uint64_t num_keys() const {
         return m_num_keys;
     }
@@ -96,6 +171,20 @@ struct single_phf {
         return m_seed;
     }
 
+    inline uint64_t pilot(uint64_t bucket) const {
+        return m_pilots.access(bucket);
+    }
+
+    /* Space breakdown: see space_auditor. */
+    template <typename Auditor>
+    void audit(Auditor& auditor) const {
+        auditor.add_bits("parameters", 8 * (sizeof(m_seed) + sizeof(m_num_keys) +
+                                            sizeof(m_table_size) + sizeof(m_M)));
+        auditor.add("bucketer", m_bucketer);
+        auditor.add("pilots", m_pilots);
+        auditor.add("free_slots", m_free_slots);
+    }
+
     template <typename Visitor>
     void visit(Visitor& visitor) {
         visitor.visit(m_seed);
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+
+#include "include/utils/probes.hpp"
+
+namespace pthash {
+
+/* at most 2^16 bins: the per-thread histograms stay in L1/L2 */
+constexpr uint64_t bulk_evaluation_max_num_bins = uint64_t(1) << 16;
+
+/* Return the shift that maps [0, universe) into at most bulk_evaluation_max_num_bins bins. */
+static inline uint64_t bulk_evaluation_shift(uint64_t universe) {
+    uint64_t shift = 0;
+    while (((universe - 1) >> shift) >= bulk_evaluation_max_num_bins) ++shift;
+    return shift;
+}
+
+/*
+    Evaluate f on num_keys keys, writing f(keys[i]) into positions[i].
+
+    The keys are hashed once and radix-partitioned (one counting-sort pass) by bin(hash),
+    where a bin is a range of consecutive buckets of f. Then the queries are evaluated
+    bin by bin, so that the pilots are scanned sequentially instead of being accessed
+    at random, and the positions are scattered back in query order.
+    Each phase uses num_threads threads: during the evaluation, each thread processes
+    a contiguous range of bins (hence, of partitions for a partitioned function).
+    The keys must be accessible through a random-access iterator.
+*/
+template <typename Hasher, typename Function, typename RandomAccessIterator,
+          typename PositionsIterator, typename BinFunction>
+void bulk_evaluate(Function const& f, RandomAccessIterator keys, uint64_t num_keys,
+                   PositionsIterator positions, uint64_t num_bins, BinFunction bin,
+                   uint64_t num_threads) {
+    typedef typename Hasher::hash_type hash_type;
+
+    struct query {
+        hash_type hash;
+        uint64_t index;
+    };
+
+    assert(num_bins > 0 and num_bins <= bulk_evaluation_max_num_bins);
+    if (num_keys == 0) return;
+    PTHASH_PROBE(lookup_batch_start, num_keys);
+    if (num_threads == 0 or num_keys < num_threads) num_threads = 1;
+    uint64_t num_keys_per_thread = (num_keys + num_threads - 1) / num_threads;
+
+    auto run = [&](auto exe) {
+        if (num_threads == 1) {
+            exe(0, 0, num_keys);
+            return;
+        }
+        std::vector<std::thread> threads(num_threads);
+        for (uint64_t t = 0; t != num_threads; ++t) {
+            uint64_t begin = std::min(t * num_keys_per_thread, num_keys);
+            uint64_t end = std::min(begin + num_keys_per_thread, num_keys);
+            threads[t] = std::thread(exe, t, begin, end);
+        }
+        for (auto& t : threads) {
+            if (t.joinable()) t.join();
+        }
+    };
+
+    /* 1. hash the keys and build the per-thread histograms */
+    std::vector<hash_type> hashes(num_keys);
+    std::vector<uint16_t> bins(num_keys);
+    std::vector<std::vector<uint64_t>> counts(num_threads, std::vector<uint64_t>(num_bins, 0));
+    run([&](uint64_t t, uint64_t begin, uint64_t end) {
+        RandomAccessIterator it = keys + begin;
+        auto& local_counts = counts[t];
+        for (uint64_t i = begin; i != end; ++i, ++it) {
+            auto hash = Hasher::hash(*it, f.seed());
+            uint64_t b = bin(hash);
+            assert(b < num_bins);
+            hashes[i] = hash;
+            bins[i] = b;
+            ++local_counts[b];
+        }
+    });
+
+    /* 2. turn the histograms into scatter offsets: bin-major, thread-minor */
+    for (uint64_t b = 0, offset = 0; b != num_bins; ++b) {
+        for (uint64_t t = 0; t != num_threads; ++t) {
+            uint64_t count = counts[t][b];
+            counts[t][b] = offset;
+            offset += count;
+        }
+    }
+
+    /* 3. scatter the queries by bin */
+    std::vector<query> queries(num_keys);
+    run([&](uint64_t t, uint64_t begin, uint64_t end) {
+        auto& offsets = counts[t];
+        for (uint64_t i = begin; i != end; ++i) queries[offsets[bins[i]]++] = {hashes[i], i};
+    });
+    std::vector<hash_type>().swap(hashes);
+    std::vector<uint16_t>().swap(bins);
+
+    /* 4. evaluate in bin order and scatter the positions back in query order */
+    run([&](uint64_t, uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i != end; ++i) {
+            auto const& q = queries[i];
+            positions[q.index] = f.position(q.hash);
+        }
+    });
+    PTHASH_PROBE(lookup_batch_end, num_keys);
+}
+
+}  // namespace pthash
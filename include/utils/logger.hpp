@@ -1,38 +1,69 @@
 #pragma once
 
-#include <ostream>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
 
 namespace pthash {
 
+/*
+    Progress of a loop over total_events events.
+
+    The hot path, log(), only decrements an atomic countdown: the shared number of logged
+    events is updated once every batch_size events, by the thread that brings the countdown
+    to zero. Hence, log() can be called by several threads at once.
+    If enabled, a background thread prints the progress and the estimated remaining
+    time every interval (hence, at a rate independent of the number of events).
+*/
 struct progress_logger {
+    static constexpr uint64_t batch_size = 4096;
+    static constexpr std::chrono::milliseconds print_interval{1000};
+
     progress_logger(uint64_t total_events, std::string const& prefix = "",
-                    std::string const& suffix = "", bool enable = true)
-        : m_total_events(total_events), m_prefix(prefix), m_suffix(suffix), m_logged_events(0) {
-        // TODO: improve the computation of log_step using timings !
-        uint64_t perc_fraction = (total_events >= 100000000) ? 100 : 20;
-        m_log_step = (total_events + perc_fraction - 1) / perc_fraction;
-        m_next_event_to_log = static_cast<uint64_t>(-1);
-        if (enable) {
-            m_next_event_to_log = m_log_step;
-            update(false);
+                    std::string const& suffix = "", bool enable = true,
+                    std::chrono::milliseconds interval = print_interval)
+        : m_total_events(total_events)
+        , m_prefix(prefix)
+        , m_suffix(suffix)
+        , m_enabled(enable)
+        , m_logged_events(0)
+        , m_countdown(batch_size)
+        , m_start(std::chrono::steady_clock::now())
+        , m_interval(interval)
+        , m_num_ticks(0)
+        , m_stop(false)
+        , m_printed_length(0) {
+        if (m_enabled) {
+            print(0, false);
+            m_ticker = std::thread([this]() { tick(); });
         }
     }
 
+    ~progress_logger() {
+        stop();
+    }
+
     inline void log() {
-        if (++m_logged_events >= m_next_event_to_log) {
-            update(false);
-            m_next_event_to_log += m_log_step;
-            // the following ensures the last update on 100%
-            if (m_next_event_to_log > m_total_events) m_next_event_to_log = m_total_events;
+        /* the other threads can take the countdown below zero until it is reset */
+        if (m_countdown.fetch_sub(1, std::memory_order_relaxed) == 1) {
+            add(batch_size);
+            m_countdown.fetch_add(batch_size, std::memory_order_relaxed);
         }
     }
 
+    /* To be called once all the threads have logged their events. */
     void finalize() {
-        if (m_next_event_to_log != static_cast<uint64_t>(-1)) {
-            assert(m_next_event_to_log == m_total_events);
-            assert(m_logged_events == m_total_events);
-            update(true);
+        add(batch_size - m_countdown.exchange(batch_size, std::memory_order_relaxed));
+        if (m_enabled) {
+            stop();
+            assert(logged_events() == m_total_events);
+            print(logged_events(), true);
+            m_enabled = false;
         }
     }
 
@@ -40,27 +71,78 @@ struct progress_logger {
         return m_total_events;
     }
 
+    /* Events flushed so far, plus those still in the countdown. */
     uint64_t logged_events() const {
-        return m_logged_events;
+        return m_logged_events.load(std::memory_order_relaxed) + batch_size -
+               m_countdown.load(std::memory_order_relaxed);
+    }
+
+    /* Number of times the background thread has printed the progress. */
+    uint64_t num_ticks() const {
+        return m_num_ticks.load(std::memory_order_acquire);
     }
 
 private:
-    inline void update(bool final) const {
-        uint64_t perc = (100 * m_logged_events / m_total_events);
-        std::cout << "\r" << m_prefix << perc << "%" << m_suffix;
+    const uint64_t m_total_events;
+    const std::string m_prefix = "";
+    const std::string m_suffix = "";
+    bool m_enabled;
+    std::atomic<uint64_t> m_logged_events;
+    std::atomic<int64_t> m_countdown;
+    std::chrono::steady_clock::time_point m_start;
+    std::chrono::milliseconds m_interval;
+    std::atomic<uint64_t> m_num_ticks;
+
+    std::thread m_ticker;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stop;
+    uint64_t m_printed_length;
+
+    inline void add(uint64_t events) {
+        m_logged_events.fetch_add(events, std::memory_order_relaxed);
+    }
+
+    void tick() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_cv.wait_for(lock, m_interval, [this]() { return m_stop; })) {
+            print(m_logged_events.load(std::memory_order_relaxed), false);
+            m_num_ticks.fetch_add(1, std::memory_order_release);
+        }
+    }
+
+    void stop() {
+        if (!m_ticker.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_one();
+        m_ticker.join();
+    }
+
+    void print(uint64_t logged_events, bool final) {
+        if (logged_events > m_total_events) logged_events = m_total_events;
+        uint64_t perc = m_total_events ? (100 * logged_events / m_total_events) : 100;
+        std::stringstream ss;
+        ss << "\r" << m_prefix << perc << "%" << m_suffix;
+        if (!final and logged_events != 0) {
+            double elapsed =
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+            uint64_t eta = elapsed * (m_total_events - logged_events) / logged_events;
+            ss << " (ETA " << eta << " seconds)";
+        }
+        std::string line = ss.str();
+        uint64_t length = line.size();
+        if (length < m_printed_length) line.append(m_printed_length - length, ' ');
+        m_printed_length = length;
+        std::cout << line;
         if (final) {
             std::cout << std::endl;
         } else {
             std::cout << std::flush;
         }
     }
-
-    const uint64_t m_total_events;
-    const std::string m_prefix = "";
-    const std::string m_suffix = "";
-    uint64_t m_logged_events;
-    uint64_t m_log_step;
-    uint64_t m_next_event_to_log;
 };
 
-}  // namespace pthash
\ No newline at end of file
+}  // namespace pthash
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "include/utils/probes.hpp"
+
+namespace pthash {
+
+/*
+    Multi-threaded lookup engine for a partitioned_phf.
+
+    Each of the num_threads workers owns a contiguous range of partitions and is the only one
+    to evaluate queries falling in them, so that the cache of each core only holds the pilots
+    of its own partitions. Worker t hashes the t-th slice of the queries and routes each query
+    to the worker owning its partition through a single-producer/single-consumer lock-free
+    queue (one queue per pair of workers). Positions are written in query order.
+*/
+template <typename Function>
+struct partition_affine_lookup {
+    typedef typename Function::hasher_type hasher_type;
+    typedef typename hasher_type::hash_type hash_type;
+
+    partition_affine_lookup(Function const& f, uint64_t num_threads,
+                            uint64_t queue_capacity = default_queue_capacity)
+        : m_f(f), m_num_threads(num_threads == 0 ? 1 : num_threads), m_queue_capacity(1) {
+        while (m_queue_capacity < queue_capacity) m_queue_capacity *= 2;
+    }
+
+    /* Write f(keys[i]) into positions[i], for i in [0, num_keys). */
+    template <typename RandomAccessIterator, typename PositionsIterator>
+    void lookup(RandomAccessIterator keys, uint64_t num_keys, PositionsIterator positions) const {
+        PTHASH_PROBE(lookup_batch_start, num_keys);
+        uint64_t num_threads = m_num_threads;
+        if (num_keys < num_threads) num_threads = 1;
+
+        if (num_threads == 1) {
+            for (uint64_t i = 0; i != num_keys; ++i, ++keys) positions[i] = m_f(*keys);
+            PTHASH_PROBE(lookup_batch_end, num_keys);
+            return;
+        }
+
+        uint64_t num_partitions = m_f.num_partitions();
+        std::vector<std::unique_ptr<queue>> queues;  // queues[producer * num_threads + consumer]
+        queues.reserve(num_threads * num_threads);
+        for (uint64_t i = 0; i != num_threads * num_threads; ++i) {
+            queues.push_back(std::make_unique<queue>(m_queue_capacity));
+        }
+        std::atomic<uint64_t> num_done_producers = 0;
+
+        auto exe = [&](uint64_t t) {
+            auto drain = [&]() {
+                for (uint64_t producer = 0; producer != num_threads; ++producer) {
+                    queues[producer * num_threads + t]->consume([&](query const& q) {
+                        positions[q.index] = m_f.position(q.hash, q.partition);
+                    });
+                }
+            };
+
+            uint64_t num_keys_per_thread = (num_keys + num_threads - 1) / num_threads;
+            uint64_t begin = std::min(t * num_keys_per_thread, num_keys);
+            uint64_t end = std::min(begin + num_keys_per_thread, num_keys);
+            RandomAccessIterator it = keys + begin;
+            for (uint64_t i = begin; i != end; ++i, ++it) {
+                auto hash = hasher_type::hash(*it, m_f.seed());
+                uint64_t partition = m_f.partition_id(hash);
+                uint64_t owner = (partition * num_threads) / num_partitions;
+                if (owner == t) {
+                    positions[i] = m_f.position(hash, partition);
+                } else {
+                    auto& q = *queues[t * num_threads + owner];
+                    // drain my own queues while waiting, so that two workers never wait
+                    // for each other
+                    while (!q.push({hash, partition, i})) {
+                        drain();
+                        std::this_thread::yield();
+                    }
+                }
+                if ((i & drain_mask) == 0) drain();
+            }
+
+            num_done_producers.fetch_add(1, std::memory_order_release);
+            while (num_done_producers.load(std::memory_order_acquire) != num_threads) {
+                drain();
+                std::this_thread::yield();
+            }
+            drain();  // all producers are done: this empties my queues
+        };
+
+        std::vector<std::thread> threads(num_threads);
+        for (uint64_t t = 0; t != num_threads; ++t) threads[t] = std::thread(exe, t);
+        for (auto& t : threads) {
+            if (t.joinable()) t.join();
+        }
+        PTHASH_PROBE(lookup_batch_end, num_keys);
+    }
+
+private:
+    static constexpr uint64_t default_queue_capacity = 4096;
+    static constexpr uint64_t drain_mask = 255;  // drain every 256 produced queries
+
+    struct query {
+        hash_type hash;
+        uint64_t partition;
+        uint64_t index;
+    };
+
+    /* Bounded single-producer/single-consumer lock-free queue. */
+    struct queue {
+        queue(uint64_t capacity)
+            : m_buffer(capacity), m_mask(capacity - 1), m_head(0), m_tail(0) {}
+
+        bool push(query const& q) {
+            uint64_t tail = m_tail.load(std::memory_order_relaxed);
+            if (tail - m_head.load(std::memory_order_acquire) == m_buffer.size()) return false;
+            m_buffer[tail & m_mask] = q;
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        template <typename Consumer>
+        void consume(Consumer consumer) {
+            uint64_t head = m_head.load(std::memory_order_relaxed);
+            uint64_t tail = m_tail.load(std::memory_order_acquire);
+            for (; head != tail; ++head) consumer(m_buffer[head & m_mask]);
+            m_head.store(tail, std::memory_order_release);
+        }
+
+    private:
+        std::vector<query> m_buffer;
+        uint64_t m_mask;
+        alignas(64) std::atomic<uint64_t> m_head;
+        alignas(64) std::atomic<uint64_t> m_tail;
+    };
+
+    Function const& m_f;
+    uint64_t m_num_threads;
+    uint64_t m_queue_capacity;
+};
+
+}  // namespace pthash
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "include/utils/telemetry.hpp"
+
+namespace pthash {
+
+/*
+    Hardware counters, read with perf_event_open (Linux only).
+
+    The counters count user-space events of the constructing thread and of all the
+    threads it spawns afterwards (the counts of a thread are added when it is joined).
+    A counter that cannot be opened (the event is not supported by the CPU, or access is
+    denied by /proc/sys/kernel/perf_event_paranoid) is not available and is never reported:
+    if no counter is available, perf_counters does nothing.
+    Counts are scaled by time_enabled/time_running when the kernel multiplexes the counters.
+*/
+struct perf_counters {
+    static constexpr uint64_t num_events = 6;
+
+    static char const* event_name(uint64_t i) {
+        static char const* names[num_events] = {"cycles",      "instructions", "l1d_misses",
+                                                "llc_misses",  "dtlb_misses",  "branch_misses"};
+        return names[i];
+    }
+
+    struct counts {
+        counts() {
+            std::fill(values, values + num_events, 0.0);
+        }
+
+        counts operator-(counts const& rhs) const {
+            counts c;
+            for (uint64_t i = 0; i != num_events; ++i) c.values[i] = values[i] - rhs.values[i];
+            return c;
+        }
+
+        double values[num_events];
+    };
+
+    perf_counters() {
+        for (uint64_t i = 0; i != num_events; ++i) m_fds[i] = open(i);
+    }
+
+    ~perf_counters() {
+#ifdef __linux__
+        for (auto fd : m_fds) {
+            if (fd != -1) ::close(fd);
+        }
+#endif
+    }
+
+    perf_counters(perf_counters const&) = delete;
+    perf_counters& operator=(perf_counters const&) = delete;
+
+    bool available() const {
+        return std::any_of(m_fds, m_fds + num_events, [](int fd) { return fd != -1; });
+    }
+
+    bool available(uint64_t i) const {
+        return m_fds[i] != -1;
+    }
+
+    counts read() const {
+        counts c;
+#ifdef __linux__
+        for (uint64_t i = 0; i != num_events; ++i) {
+            if (m_fds[i] == -1) continue;
+            uint64_t buf[3];  // value, time_enabled, time_running
+            if (::read(m_fds[i], buf, sizeof(buf)) != sizeof(buf) or buf[2] == 0) continue;
+            c.values[i] = static_cast<double>(buf[0]) * buf[1] / buf[2];
+        }
+#endif
+        return c;
+    }
+
+    /* Add "<prefix><event><suffix>" = count / divisor to result, for every available counter. */
+    template <typename JsonLines>
+    void add_to(JsonLines& result, counts const& c, std::string const& prefix,
+                std::string const& suffix, double divisor) const {
+        for (uint64_t i = 0; i != num_events; ++i) {
+            if (available(i)) result.add(prefix + event_name(i) + suffix, c.values[i] / divisor);
+        }
+    }
+
+private:
+    int m_fds[num_events];
+
+    static int open(uint64_t i) {
+#ifdef __linux__
+        static const uint64_t l1d_read_miss = PERF_COUNT_HW_CACHE_L1D |
+                                              (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        static const uint64_t dtlb_read_miss = PERF_COUNT_HW_CACHE_DTLB |
+                                               (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                               (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        static const uint32_t types[num_events] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                                   PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE,
+                                                   PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE};
+        static const uint64_t configs[num_events] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, l1d_read_miss,
+            PERF_COUNT_HW_CACHE_MISSES, dtlb_read_miss, PERF_COUNT_HW_BRANCH_MISSES};
+
+        struct perf_event_attr attr;
+        std::fill(reinterpret_cast<char*>(&attr), reinterpret_cast<char*>(&attr) + sizeof(attr),
+                  0);
+        attr.size = sizeof(attr);
+        attr.type = types[i];
+        attr.config = configs[i];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.inherit = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        // pid = 0 and cpu = -1: the calling thread (and its future children), on any cpu
+        long fd = ::syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        return fd < 0 ? -1 : static_cast<int>(fd);
+#else
+        (void)i;
+        return -1;
+#endif
+    }
+};
+
+/*
+    Telemetry sink recording the hardware counters of each construction phase,
+    and forwarding every event to another sink.
+    For the partitioned builders, the partitions (mapping+ordering and searching)
+    are built between the end of the partitioning phase and the start of the next phase:
+    their counters are available as partitions().
+    Phases are expected to be reported by one thread at a time.
+*/
+struct perf_telemetry_sink : telemetry_sink {
+    perf_telemetry_sink(perf_counters const& counters, telemetry_sink* next)
+        : m_counters(counters), m_next(next), m_partitioning_done(false) {
+        std::fill(m_done, m_done + num_phases, false);
+    }
+
+    bool enabled() const override {
+        return m_next->enabled();
+    }
+
+    void phase_start(build_phase phase) override {
+        auto now = m_counters.read();
+        if (m_partitioning_done) {
+            m_partitions = now - m_partitions;
+            m_partitioning_done = false;
+        }
+        m_start[index(phase)] = now;
+        m_next->phase_start(phase);
+    }
+
+    void phase_end(build_phase phase, double seconds, uint64_t bytes) override {
+        auto now = m_counters.read();
+        m_phases[index(phase)] = now - m_start[index(phase)];
+        m_done[index(phase)] = true;
+        if (phase == build_phase::partitioning) {
+            m_partitions = now;
+            m_partitioning_done = true;
+        }
+        m_next->phase_end(phase, seconds, bytes);
+    }
+
+    void partition_done(uint64_t partition, uint64_t num_keys, double mapping_ordering_seconds,
+                        double searching_seconds) override {
+        m_next->partition_done(partition, num_keys, mapping_ordering_seconds, searching_seconds);
+    }
+
+    void search_window(uint64_t num_buckets_in_window, uint64_t processed_buckets,
+                       uint64_t num_buckets, uint64_t placed_keys, uint64_t trials,
+                       double expected_trials, double seconds) override {
+        m_next->search_window(num_buckets_in_window, processed_buckets, num_buckets, placed_keys,
+                              trials, expected_trials, seconds);
+    }
+
+    void io(build_phase phase, uint64_t bytes_read, uint64_t bytes_written) override {
+        m_next->io(phase, bytes_read, bytes_written);
+    }
+
+    /* Whether the phase ended at least once. */
+    bool done(build_phase phase) const {
+        return m_done[index(phase)];
+    }
+
+    /* Counters of the last occurrence of the phase. */
+    perf_counters::counts const& phase(build_phase phase) const {
+        return m_phases[index(phase)];
+    }
+
+    perf_counters::counts const& partitions() const {
+        return m_partitions;
+    }
+
+private:
+    static constexpr uint64_t num_phases = 4;
+
+    perf_counters const& m_counters;
+    telemetry_sink* m_next;
+    perf_counters::counts m_start[num_phases];
+    perf_counters::counts m_phases[num_phases];
+    bool m_done[num_phases];
+    perf_counters::counts m_partitions;
+    bool m_partitioning_done;
+
+    static uint64_t index(build_phase phase) {
+        return static_cast<uint64_t>(phase);
+    }
+};
+
+}  // namespace pthash
@@ -0,0 +1,54 @@
+#pragma once
+
+/*
+    Static tracepoints (USDT) of the "pthash" provider, for tracing running builds and lookups
+    with eBPF tools, e.g.,
+
+        bpftrace -e 'usdt:./build:pthash:phase_end { printf("%d: %d bytes\n", arg0, arg1); }'
+
+    The probes are compiled in only with PTHASH_ENABLE_USDT (see CMakeLists.txt), which
+    requires <sys/sdt.h> (systemtap-sdt-dev on Debian/Ubuntu). Otherwise PTHASH_PROBE expands
+    to an unevaluated use of its arguments (so that they are not reported as unused), and
+    PTHASH_PROBE_ENABLED to false. A compiled-in probe is a nop until a tracer attaches to it:
+    each probe has a semaphore, incremented by the attached tracers, so that
+    PTHASH_PROBE_ENABLED(name) tells whether it is worth computing the arguments of the probe.
+    The probes and their (integer) arguments are:
+
+    - phase_start(phase), phase_end(phase, bytes): a construction phase (also of the single
+      partitions of a partitioned builder), with phase the value of build_phase and bytes
+      as for telemetry_sink::phase_end;
+    - spill_write(bytes), spill_read(bytes): data written to and read back from the temporary
+      files of the external-memory builders;
+    - search_window(processed_buckets, num_buckets, placed_keys, trials): progress of the search,
+      every 5% of the buckets;
+    - lookup_batch_start(num_keys), lookup_batch_end(num_keys): a batch of lookups
+      (bulk_evaluate and partition_affine_lookup).
+*/
+
+#ifdef PTHASH_ENABLE_USDT
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define PTHASH_PROBE_SEMAPHORE(name)                                       \
+    __extension__ inline volatile unsigned short pthash_##name##_semaphore \
+        __attribute__((unused)) __attribute__((section(".probes"))) = 0
+
+PTHASH_PROBE_SEMAPHORE(phase_start);
+PTHASH_PROBE_SEMAPHORE(phase_end);
+PTHASH_PROBE_SEMAPHORE(spill_write);
+PTHASH_PROBE_SEMAPHORE(spill_read);
+PTHASH_PROBE_SEMAPHORE(search_window);
+PTHASH_PROBE_SEMAPHORE(lookup_batch_start);
+PTHASH_PROBE_SEMAPHORE(lookup_batch_end);
+
+#define PTHASH_PROBE(name, ...) STAP_PROBEV(pthash, name, __VA_ARGS__)
+#define PTHASH_PROBE_ENABLED(name) __builtin_expect(pthash_##name##_semaphore != 0, 0)
+#else
+namespace pthash::detail {
+template <typename... Args>
+int probe_arguments(Args const&...);  // only used in unevaluated contexts
+}
+#define PTHASH_PROBE(name, ...) \
+    static_cast<void>(sizeof(pthash::detail::probe_arguments(__VA_ARGS__)))
+#define PTHASH_PROBE_ENABLED(name) false
+#endif
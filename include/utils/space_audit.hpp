@@ -0,0 +1,96 @@
+#pragma once
+
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace pthash {
+
+/*
+    Space breakdown of a data structure by component.
+
+    A composite type exposes its components with
+
+        template <typename Auditor>
+        void audit(Auditor& auditor) const;
+
+    calling auditor.add(name, component) for each of them, or auditor.add_bits(name, bits)
+    for the fields that have no type of their own. Types without audit are leaves, whose space
+    is num_bits(), or 8 * bytes().
+    Components are identified by their path from the root (e.g., "pilots/front/ranks"):
+    components with the same path, like the pilots of all the partitions, are summed.
+*/
+struct space_auditor {
+    struct entry {
+        std::string path;
+        uint64_t depth;
+        uint64_t bits;
+        uint64_t count;  // number of components summed into this entry
+    };
+
+    template <typename T>
+    void add(std::string const& name, T const& component) {
+        uint64_t i = enter(name);
+        uint64_t total_bits = m_total_bits;
+        if constexpr (has_audit<T>::value) {
+            m_path.push_back(name);
+            component.audit(*this);
+            m_path.pop_back();
+        } else if constexpr (has_num_bits<T>::value) {
+            m_total_bits += component.num_bits();
+        } else {
+            m_total_bits += 8 * component.bytes();
+        }
+        m_entries[i].bits += m_total_bits - total_bits;
+    }
+
+    void add_bits(std::string const& name, uint64_t bits) {
+        uint64_t i = enter(name);
+        m_entries[i].bits += bits;
+        m_total_bits += bits;
+    }
+
+    /* In pre-order: every entry is followed by the entries of its components. */
+    std::vector<entry> const& entries() const {
+        return m_entries;
+    }
+
+    uint64_t total_bits() const {
+        return m_total_bits;
+    }
+
+private:
+    std::vector<std::string> m_path;
+    std::vector<entry> m_entries;
+    std::unordered_map<std::string, uint64_t> m_index;
+    uint64_t m_total_bits = 0;
+
+    template <typename T, typename = void>
+    struct has_audit : std::false_type {};
+    template <typename T>
+    struct has_audit<
+        T, std::void_t<decltype(std::declval<T const&>().audit(std::declval<space_auditor&>()))>>
+        : std::true_type {};
+
+    template <typename T, typename = void>
+    struct has_num_bits : std::false_type {};
+    template <typename T>
+    struct has_num_bits<T, std::void_t<decltype(std::declval<T const&>().num_bits())>>
+        : std::true_type {};
+
+    uint64_t enter(std::string const& name) {
+        std::string path;
+        for (auto const& p : m_path) path += p + "/";
+        path += name;
+        auto it = m_index.find(path);
+        if (it == m_index.end()) {
+            it = m_index.emplace(path, m_entries.size()).first;
+            m_entries.push_back({path, m_path.size(), 0, 0});
+        }
+        m_entries[it->second].count += 1;
+        return it->second;
+    }
+};
+
+}  // namespace pthash
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+#include "include/utils/util.hpp"
+#include "include/utils/probes.hpp"
+
+namespace pthash {
+
+enum class build_phase { partitioning, mapping_ordering, searching, encoding };
+
+static inline char const* phase_name(build_phase phase) {
+    switch (phase) {
+        case build_phase::partitioning:
+            return "partitioning";
+        case build_phase::mapping_ordering:
+            return "mapping_ordering";
+        case build_phase::searching:
+            return "searching";
+        case build_phase::encoding:
+            return "encoding";
+    }
+    return "unknown";
+}
+
+/*
+    Receiver of typed construction events, set via build_configuration::telemetry.
+    Every event does nothing by default. Events can be emitted concurrently
+    by different construction threads.
+
+    - phase_start/phase_end: a phase of the construction; bytes is the size of the
+      data produced by the phase (pairs and buckets, pilots and free slots, encoded function).
+    - partition_done: a partition of a partitioned builder has been built (mapping+ordering
+      and searching of a partition are not reported as separate phases).
+    - search_window: statistics of a window of consecutive buckets processed by the search.
+    - io: bytes read from and written to disk by a phase of an external-memory builder.
+*/
+struct telemetry_sink {
+    virtual ~telemetry_sink() {}
+
+    /* If false, the builders skip the computation of the events. */
+    virtual bool enabled() const {
+        return true;
+    }
+
+    virtual void phase_start(build_phase /* phase */) {}
+    virtual void phase_end(build_phase /* phase */, double /* seconds */, uint64_t /* bytes */) {}
+    virtual void partition_done(uint64_t /* partition */, uint64_t /* num_keys */,
+                                double /* mapping_ordering_seconds */,
+                                double /* searching_seconds */) {}
+    virtual void search_window(uint64_t /* num_buckets_in_window */,
+                               uint64_t /* processed_buckets */, uint64_t /* num_buckets */,
+                               uint64_t /* placed_keys */, uint64_t /* trials */,
+                               double /* expected_trials */, double /* seconds */) {}
+    virtual void io(build_phase /* phase */, uint64_t /* bytes_read */,
+                    uint64_t /* bytes_written */) {}
+};
+
+struct noop_telemetry_sink : telemetry_sink {
+    bool enabled() const override {
+        return false;
+    }
+};
+
+inline noop_telemetry_sink noop_telemetry;
+
+/* Report a phase to the sink and to the phase_start/phase_end probes (see probes.hpp). */
+static inline void report_phase_start(telemetry_sink* telemetry, build_phase phase) {
+    PTHASH_PROBE(phase_start, static_cast<int>(phase));
+    telemetry->phase_start(phase);
+}
+
+static inline void report_phase_end(telemetry_sink* telemetry, build_phase phase, double seconds,
+                                    uint64_t bytes) {
+    PTHASH_PROBE(phase_end, static_cast<int>(phase), bytes);
+    telemetry->phase_end(phase, seconds, bytes);
+}
+
+/* Write one JSON object per event (and per line) to the given stream. */
+struct json_lines_telemetry_sink : telemetry_sink {
+    json_lines_telemetry_sink(std::ostream& os) : m_os(os), m_start(clock_type::now()) {}
+
+    void phase_start(build_phase phase) override {
+        std::stringstream ss;
+        ss << "\"phase\": \"" << phase_name(phase) << "\"";
+        write("phase_start", ss.str());
+    }
+
+    void phase_end(build_phase phase, double seconds, uint64_t bytes) override {
+        std::stringstream ss;
+        ss << "\"phase\": \"" << phase_name(phase) << "\", \"seconds\": " << seconds
+           << ", \"bytes\": " << bytes;
+        write("phase_end", ss.str());
+    }
+
+    void partition_done(uint64_t partition, uint64_t num_keys, double mapping_ordering_seconds,
+                        double searching_seconds) override {
+        std::stringstream ss;
+        ss << "\"partition\": " << partition << ", \"num_keys\": " << num_keys
+           << ", \"mapping_ordering_seconds\": " << mapping_ordering_seconds
+           << ", \"searching_seconds\": " << searching_seconds;
+        write("partition_done", ss.str());
+    }
+
+    void search_window(uint64_t num_buckets_in_window, uint64_t processed_buckets,
+                       uint64_t num_buckets, uint64_t placed_keys, uint64_t trials,
+                       double expected_trials, double seconds) override {
+        std::stringstream ss;
+        ss << "\"num_buckets_in_window\": " << num_buckets_in_window
+           << ", \"processed_buckets\": " << processed_buckets
+           << ", \"num_buckets\": " << num_buckets << ", \"placed_keys\": " << placed_keys
+           << ", \"trials\": " << trials << ", \"expected_trials\": " << expected_trials
+           << ", \"seconds\": " << seconds;
+        write("search_window", ss.str());
+    }
+
+    void io(build_phase phase, uint64_t bytes_read, uint64_t bytes_written) override {
+        std::stringstream ss;
+        ss << "\"phase\": \"" << phase_name(phase) << "\", \"bytes_read\": " << bytes_read
+           << ", \"bytes_written\": " << bytes_written;
+        write("io", ss.str());
+    }
+
+private:
+    std::ostream& m_os;
+    clock_type::time_point m_start;
+    std::mutex m_mutex;
+
+    void write(char const* event, std::string const& fields) {
+        double elapsed = std::chrono::duration<double>(clock_type::now() - m_start).count();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_os << "{\"event\": \"" << event << "\", \"time\": " << elapsed << ", " << fields
+             << "}\n";
+        m_os.flush();
+    }
+};
+
+}  // namespace pthash
@@ -1,9 +1,11 @@
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <thread>
-#include <unordered_set>
 
 #include "external/cmd_line_parser/include/parser.hpp"
 #include "include/pthash.hpp"
+#include "include/utils/perf_counters.hpp"
 #include "src/util.hpp"
 
 using namespace pthash;
@@ -17,6 +19,8 @@ struct build_parameters {
     bool external_memory, check, lookup;
     std::string encoder_type;
     std::string output_filename;
+    perf_counters const* counters = nullptr;  // hardware counters, if available
+    perf_telemetry_sink const* perf_sink = nullptr;
 };
 
 template <typename Function, typename Builder, typename Iterator>
@@ -47,34 +51,47 @@ void build_benchmark(Builder& builder, build_timings const& timings,
         std::cout << "total: " << bits_per_key << " [bits/key]" << std::endl;
     }
 
+    // f, or f evaluated with position(hash) for inputs of hashes
+    auto const& g = evaluator<Iterator>(f);
+
     // correctness check
     if (params.check) {
         if (config.verbose_output) {
             essentials::logger("checking data structure for correctness...");
         }
-        if (check(params.keys, f) and config.verbose_output) {
+        if (check(params.keys, g, config.num_threads) and config.verbose_output) {
             std::cout << "EVERYTHING OK!" << std::endl;
         }
     }
 
     double nanosec_per_key = 0;
+    perf_counters::counts lookup_counts;
     if (params.lookup) {
         if (config.verbose_output) essentials::logger("measuring lookup time...");
         if (params.external_memory) {
-            std::vector<typename Iterator::value_type> queries;
+            std::vector<key_type_t<Iterator>> queries;
             uint64_t remaining = params.num_keys, batch_size = 100 * 1000000;
             Iterator query = params.keys;
             while (remaining > 0) {
                 auto cur_batch_size = std::min(remaining, batch_size);
                 queries.reserve(cur_batch_size);
                 for (uint64_t i = 0; i != cur_batch_size; ++i, ++query) queries.push_back(*query);
-                nanosec_per_key += perf(queries.begin(), cur_batch_size, f) * cur_batch_size;
+                auto before = params.counters ? params.counters->read() : lookup_counts;
+                nanosec_per_key += perf(queries.begin(), cur_batch_size, g) * cur_batch_size;
+                if (params.counters) {
+                    auto delta = params.counters->read() - before;
+                    for (uint64_t i = 0; i != perf_counters::num_events; ++i) {
+                        lookup_counts.values[i] += delta.values[i];
+                    }
+                }
                 remaining -= cur_batch_size;
                 queries.clear();
             }
             nanosec_per_key /= params.num_keys;
         } else {
-            nanosec_per_key = perf(params.keys, params.num_keys, f);
+            auto before = params.counters ? params.counters->read() : lookup_counts;
+            nanosec_per_key = perf(params.keys, params.num_keys, g);
+            if (params.counters) lookup_counts = params.counters->read() - before;
         }
         if (config.verbose_output) std::cout << nanosec_per_key << " [nanosec/key]" << std::endl;
     }
@@ -100,6 +117,30 @@ void build_benchmark(Builder& builder, build_timings const& timings,
     result.add("mapper_bits_per_key", mapper_bits_per_key);
     result.add("bits_per_key", bits_per_key);
     result.add("nanosec_per_key", nanosec_per_key);
+    if (params.counters) {
+        auto const& counters = *params.counters;
+        auto const& sink = *params.perf_sink;
+        std::string const suffix = "_per_key";
+        if (sink.done(build_phase::partitioning)) {
+            counters.add_to(result, sink.phase(build_phase::partitioning), "partitioning_", suffix,
+                            params.num_keys);
+        }
+        if (sink.done(build_phase::mapping_ordering)) {
+            counters.add_to(result, sink.phase(build_phase::mapping_ordering),
+                            "mapping_ordering_", suffix, params.num_keys);
+            counters.add_to(result, sink.phase(build_phase::searching), "searching_", suffix,
+                            params.num_keys);
+        } else {  // partitioned builders: mapping+ordering and searching of the partitions
+            counters.add_to(result, sink.partitions(), "mapping_ordering_searching_", suffix,
+                            params.num_keys);
+        }
+        counters.add_to(result, sink.phase(build_phase::encoding), "encoding_", suffix,
+                        params.num_keys);
+        if (params.lookup) {
+            counters.add_to(result, lookup_counts, "lookup_", suffix,
+                            perf_runs * params.num_keys);
+        }
+    }
     result.print_line();
 
     if (params.output_filename != "") {
@@ -136,46 +177,18 @@ void choose_encoder(build_parameters<Iterator> const& params, build_configuratio
     if (config.verbose_output) essentials::logger("construction starts");
 
     Builder builder;
-    build_timings timings = builder.build_from_keys(params.keys, params.num_keys, config);
-
-    bool encode_all = (params.encoder_type == "all");
-
-#ifdef PTHASH_ENABLE_ALL_ENCODERS
-    if (encode_all or params.encoder_type == "compact") {
-        choose_phf<partitioned, compact>(builder, timings, params, config);
-    }
-    if (encode_all or params.encoder_type == "partitioned_compact") {
-        choose_phf<partitioned, partitioned_compact>(builder, timings, params, config);
-    }
-    if (encode_all or params.encoder_type == "compact_compact") {
-        choose_phf<partitioned, compact_compact>(builder, timings, params, config);
-    }
-    if (encode_all or params.encoder_type == "dictionary") {
-        choose_phf<partitioned, dictionary>(builder, timings, params, config);
-    }
-    if (encode_all or params.encoder_type == "dictionary_dictionary") {
-        choose_phf<partitioned, dictionary_dictionary>(builder, timings, params, config);
-    }
-    if (encode_all or params.encoder_type == "elias_fano") {
-        choose_phf<partitioned, elias_fano>(builder, timings, params, config);
-    }
-    if (encode_all or params.encoder_type == "dictionary_elias_fano") {
-        choose_phf<partitioned, dictionary_elias_fano>(builder, timings, params, config);
-    }
-    if (encode_all or params.encoder_type == "sdc") {
-        choose_phf<partitioned, sdc>(builder, timings, params, config);
-    }
-#else
-    if (encode_all or params.encoder_type == "partitioned_compact") {
-        choose_phf<partitioned, partitioned_compact>(builder, timings, params, config);
-    }
-    if (encode_all or params.encoder_type == "dictionary_dictionary") {
-        choose_phf<partitioned, dictionary_dictionary>(builder, timings, params, config);
-    }
-    if (encode_all or params.encoder_type == "elias_fano") {
-        choose_phf<partitioned, elias_fano>(builder, timings, params, config);
+    build_timings timings;
+    if constexpr (is_hash<key_type_t<Iterator>>::value) {
+        timings = builder.build_from_hashes(params.keys, params.num_keys, config);
+    } else {
+        timings = builder.build_from_keys(params.keys, params.num_keys, config);
     }
-#endif
+    if (config.search_statistics) builder.search_stats().print();
+
+    for_each_encoder(params.encoder_type, [&](auto encoder) {
+        typedef typename decltype(encoder)::type Encoder;
+        choose_phf<partitioned, Encoder>(builder, timings, params, config);
+    });
 }
 
 template <typename Hasher, typename Iterator>
@@ -197,7 +210,12 @@ void choose_builder(build_parameters<Iterator> const& params, build_configuratio
 
 template <typename Iterator>
 void choose_hasher(build_parameters<Iterator> const& params, build_configuration const& config) {
-    if (params.num_keys <= (uint64_t(1) << 30)) {
+    typedef key_type_t<Iterator> key_type;
+    if constexpr (std::is_same_v<key_type, hash64>) {  // the hasher is given by the hashes
+        choose_builder<murmurhash2_64>(params, config);
+    } else if constexpr (std::is_same_v<key_type, hash128>) {
+        choose_builder<murmurhash2_128>(params, config);
+    } else if (params.num_keys <= (uint64_t(1) << 30)) {
         choose_builder<murmurhash2_64>(params, config);
     } else {
         choose_builder<murmurhash2_128>(params, config);
@@ -212,19 +230,9 @@ void build(cmd_line_parser::parser const& parser, Iterator keys, uint64_t num_ke
     params.lookup = parser.get<bool>("lookup");
 
     params.encoder_type = parser.get<std::string>("encoder_type");
-    {
-        std::unordered_set<std::string> encoders({
-#ifdef PTHASH_ENABLE_ALL_ENCODERS
-            "compact", "partitioned_compact", "compact_compact", "dictionary",
-            "dictionary_dictionary", "elias_fano", "dictionary_elias_fano", "sdc", "all"
-#else
-            "partitioned_compact", "dictionary_dictionary", "elias_fano", "all"
-#endif
-        });
-        if (encoders.find(params.encoder_type) == encoders.end()) {
-            std::cerr << "unknown encoder type" << std::endl;
-            return;
-        }
+    if (!for_each_encoder(params.encoder_type, [](auto) {})) {
+        std::cerr << "unknown encoder type" << std::endl;
+        return;
     }
 
     params.output_filename =
@@ -235,6 +243,7 @@ void build(cmd_line_parser::parser const& parser, Iterator keys, uint64_t num_ke
     config.alpha = parser.get<double>("alpha");
     config.minimal_output = parser.get<bool>("minimal_output");
     config.verbose_output = parser.get<bool>("verbose_output");
+    config.search_statistics = parser.get<bool>("search_statistics");
 
     config.num_partitions = 1;
     if (parser.parsed("num_partitions")) {
@@ -256,6 +265,10 @@ void build(cmd_line_parser::parser const& parser, Iterator keys, uint64_t num_ke
     }
 
     if (parser.parsed("seed")) config.seed = parser.get<uint64_t>("seed");
+    /* build_from_hashes does not draw a seed: the hashes are given */
+    if (is_hash<key_type_t<Iterator>>::value and config.seed == constants::invalid_seed) {
+        config.seed = random_value();
+    }
     if (parser.parsed("tmp_dir")) config.tmp_dir = parser.get<std::string>("tmp_dir");
 
     if (parser.parsed("ram")) {
@@ -271,7 +284,90 @@ void build(cmd_line_parser::parser const& parser, Iterator keys, uint64_t num_ke
         config.ram = ram;
     }
 
-    choose_hasher(params, config);
+    std::ofstream telemetry_out;
+    std::unique_ptr<json_lines_telemetry_sink> telemetry;
+    if (parser.parsed("telemetry_filename")) {
+        auto telemetry_filename = parser.get<std::string>("telemetry_filename");
+        telemetry_out.open(telemetry_filename.c_str());
+        if (!telemetry_out.is_open()) {
+            std::cerr << "cannot open '" << telemetry_filename << "'" << std::endl;
+            return;
+        }
+        telemetry = std::make_unique<json_lines_telemetry_sink>(telemetry_out);
+        config.telemetry = telemetry.get();
+    }
+
+    /* opened before construction, so that the counters follow the construction threads */
+    std::unique_ptr<perf_counters> counters;
+    std::unique_ptr<perf_telemetry_sink> perf_sink;
+    if (parser.get<bool>("perf_counters")) {
+        counters = std::make_unique<perf_counters>();
+        if (counters->available()) {
+            perf_sink = std::make_unique<perf_telemetry_sink>(*counters, config.telemetry);
+            config.telemetry = perf_sink.get();
+            params.counters = counters.get();
+            params.perf_sink = perf_sink.get();
+        } else {
+            std::cout << "Warning: hardware counters are not available (perf_event_open failed)"
+                      << std::endl;
+        }
+    }
+
+    try {
+        choose_hasher(params, config);
+    } catch (duplicate_keys_error const& e) {
+        print_duplicate_keys(params.keys, e.duplicates());
+        throw;
+    }
+}
+
+/*
+    Build over an in-memory collection of keys. With --drop-duplicates, the duplicate keys
+    reported by the builder (see duplicate_keys_error) are removed and the function is
+    built again.
+*/
+template <typename Collection>
+void build_dropping_duplicates(cmd_line_parser::parser const& parser, Collection& keys) {
+    try {
+        build(parser, keys.begin(), keys.size());
+    } catch (duplicate_keys_error const& e) {
+        if (!parser.get<bool>("drop_duplicates")) throw;
+        std::vector<uint64_t> indices;
+        indices.reserve(e.duplicates().size());
+        for (auto const& duplicate : e.duplicates()) indices.push_back(duplicate.first);
+        drop(keys, indices);
+        std::cout << "dropped " << indices.size() << " duplicate keys: building again with "
+                  << keys.size() << " keys" << std::endl;
+        build(parser, keys.begin(), keys.size());
+    }
+}
+
+/* Inputs of fixed-width binary keys (-b) or of precomputed hashes (-H), read in place. */
+void build_from_binary_file(cmd_line_parser::parser const& parser,
+                            std::string const& input_filename, uint64_t num_keys) {
+    bool hashes = parser.parsed("input_hash_bits");
+    uint64_t key_bytes = hashes ? parser.get<uint64_t>("input_hash_bits") / 8
+                                : parser.get<uint64_t>("input_key_bytes");
+    mm::file_source<uint8_t> input(input_filename, parser.get<bool>("external_memory")
+                                                       ? mm::advice::sequential
+                                                       : mm::advice::normal);
+    if (input.size() % key_bytes != 0) {
+        std::cout << "Warning: the size of the file is not a multiple of " << key_bytes
+                  << " bytes; ignoring the last " << input.size() % key_bytes << " bytes"
+                  << std::endl;
+    }
+    if (num_keys > input.size() / key_bytes) {
+        num_keys = input.size() / key_bytes;
+        std::cout << "Warning: the file contains only " << num_keys << " keys" << std::endl;
+    }
+    if (!hashes) {
+        build(parser, fixed_width_iterator(input.data(), key_bytes), num_keys);
+    } else if (key_bytes == 8) {
+        build(parser, reinterpret_cast<hash64 const*>(input.data()), num_keys);
+    } else {
+        build(parser, reinterpret_cast<hash128 const*>(input.data()), num_keys);
+    }
+    input.close();
 }
 
 int main(int argc, char** argv) {
@@ -286,17 +382,8 @@ int main(int argc, char** argv) {
     parser.add("alpha", "The table load factor. It must be a quantity > 0 and <= 1.", "-a", true);
 
     parser.add("encoder_type",
-               "The encoder type. Possibile values are: "
-#ifdef PTHASH_ENABLE_ALL_ENCODERS
-               "'compact', 'partitioned_compact', 'compact_compact', 'dictionary', "
-               "'dictionary_dictionary', 'elias_fano', 'dictionary_elias_fano', 'sdc', "
-               "'all'.\n\t"
-#else
-               "'partitioned_compact', 'dictionary_dictionary', 'elias_fano', "
-               "'all'.\n\t"
-               "(For more encoders, compile again with 'cmake .. -D "
-               "PTHASH_ENABLE_ALL_ENCODERS=On').\n\t"
-#endif
+               "The encoder type. Possibile values are: " + encoder_names_list() +
+                   ", 'all'.\n\t"
                "The 'all' type will just benchmark all encoders. (Useful for benchmarking "
                "purposes.)",
                "-e", true);
@@ -308,8 +395,20 @@ int main(int argc, char** argv) {
     parser.add("input_filename",
                "A string input file name. If this is not provided, then num_keys 64-bit random "
                "keys will be used as input instead."
-               "If, instead, the filename is '-', then input is read from standard input.",
+               "If, instead, the filename is '-', then input is read from standard input. "
+               "Several files (e.g., shards) can be given as a comma-separated list of file "
+               "names and glob patterns, such as 'shards/part-*.txt': their lines are read "
+               "one file after the other.",
                "-i", false);
+    parser.add("input_key_bytes",
+               "The input file is binary, of fixed-width keys of this many bytes each "
+               "(e.g., 4, 8 or 16 for columns of 32-, 64- or 128-bit integers).",
+               "-b", false);
+    parser.add("input_hash_bits",
+               "The input file is binary, of precomputed hashes of 64 or 128 bits each "
+               "(for 128 bits, the first and then the second 64-bit half of each hash). "
+               "The function is built with build_from_hashes.",
+               "-H", false);
     parser.add("output_filename", "Output file name where the function will be serialized.", "-o",
                false);
     parser.add("tmp_dir",
@@ -318,13 +417,28 @@ int main(int argc, char** argv) {
                "-d", false);
     parser.add("ram", "Number of Giga bytes of RAM to use for construction in external memory.",
                "-m", false);
+    parser.add("telemetry_filename",
+               "File name where construction events are written, one JSON object per line.", "-T",
+               false);
     parser.add("minimal_output", "Build a minimal PHF.", "--minimal", false, true);
     parser.add("external_memory", "Build the function in external memory.", "--external", false,
                true);
     parser.add("verbose_output", "Verbose output during construction.", "--verbose", false, true);
-    parser.add("check", "Check correctness after construction.", "--check", false, true);
+    parser.add("search_statistics",
+               "Print statistics of the search (pilots, trials and time per bucket size).",
+               "--search-stats", false, true);
+    parser.add("perf_counters",
+               "Report the hardware counters (cycles, instructions, cache, TLB and branch misses) "
+               "per key of each construction phase and of the lookups (Linux only).",
+               "--perf", false, true);
+    parser.add("check", "Check correctness after construction, with num_threads threads.",
+               "--check", false, true);
     parser.add("lookup", "Measure average lookup time after construction.", "--lookup", false,
                true);
+    parser.add("drop_duplicates",
+               "Drop the duplicate keys (keeping their first occurrence) and build again, "
+               "instead of failing. Only for string input files in internal memory, or stdin.",
+               "--drop-duplicates", false, true);
 
     if (!parser.parse()) return 1;
     if (parser.parsed("input_filename") && parser.get<std::string>("input_filename") == "-" &&
@@ -337,41 +451,99 @@ int main(int argc, char** argv) {
         }
     }
 
+    bool binary_input = parser.parsed("input_key_bytes") or parser.parsed("input_hash_bits");
+    if (binary_input) {
+        if (!parser.parsed("input_filename") or parser.get<std::string>("input_filename") == "-") {
+            std::cerr << "binary input (-b or -H) requires an input file name" << std::endl;
+            return 1;
+        }
+        if (parser.parsed("input_key_bytes") and parser.parsed("input_hash_bits")) {
+            std::cerr << "-b and -H cannot be used together" << std::endl;
+            return 1;
+        }
+        if (parser.parsed("input_key_bytes") and parser.get<uint64_t>("input_key_bytes") == 0) {
+            std::cerr << "the number of bytes per key must be > 0" << std::endl;
+            return 1;
+        }
+        if (parser.parsed("input_hash_bits")) {
+            auto hash_bits = parser.get<uint64_t>("input_hash_bits");
+            if (hash_bits != 64 and hash_bits != 128) {
+                std::cerr << "hashes must be of 64 or 128 bits" << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    if (parser.get<bool>("drop_duplicates") and
+        (binary_input or parser.get<bool>("external_memory") or
+         !parser.parsed("input_filename"))) {
+        std::cerr << "--drop-duplicates requires a string input file (or stdin) in internal memory"
+                  << std::endl;
+        return 1;
+    }
+
     auto num_keys = parser.get<uint64_t>("num_keys");
     auto seed = (parser.parsed("seed")) ? parser.get<uint64_t>("seed") : constants::invalid_seed;
     bool external_memory = parser.get<bool>("external_memory");
 
-    if (parser.parsed("input_filename")) {
-        auto input_filename = parser.get<std::string>("input_filename");
-        if (external_memory) {
-            if (input_filename == "-") {
-                sequential_lines_iterator keys(std::cin);
-                build(parser, keys, num_keys);
-            } else {
-                mm::file_source<uint8_t> input(input_filename, mm::advice::sequential);
-                lines_iterator keys(input.data(), input.data() + input.size());
-                build(parser, keys, num_keys);
-                input.close();
+    try {
+        if (parser.parsed("input_filename")) {
+            auto input_filename = parser.get<std::string>("input_filename");
+            std::vector<std::string> input_filenames;
+            if (input_filename != "-") {
+                input_filenames = input_files(input_filename);
+                if (input_filenames.empty()) {
+                    std::cerr << "no input file" << std::endl;
+                    return 1;
+                }
             }
-        } else {
-            std::vector<std::string> keys;
-            if (input_filename == "-") {
-                keys =
+            if (binary_input) {
+                if (input_filenames.size() > 1) {
+                    std::cerr << "binary input (-b or -H) must be a single file" << std::endl;
+                    return 1;
+                }
+                build_from_binary_file(parser, input_filename, num_keys);
+            } else if (external_memory) {
+                if (input_filename == "-") {
+                    sequential_lines_iterator keys(std::cin);
+                    build(parser, keys, num_keys);
+                } else if (input_filenames.size() > 1) {
+                    std::vector<mm::file_source<uint8_t>> inputs(input_filenames.size());
+                    for (uint64_t i = 0; i != inputs.size(); ++i) {
+                        inputs[i].open(input_filenames[i], mm::advice::sequential);
+                    }
+                    files_lines_iterator keys(inputs);
+                    build(parser, keys, num_keys);
+                    for (auto& input : inputs) input.close();
+                } else {
+                    mm::file_source<uint8_t> input(input_filename, mm::advice::sequential);
+                    lines_iterator keys(input.data(), input.data() + input.size());
+                    build(parser, keys, num_keys);
+                    input.close();
+                }
+            } else if (input_filename == "-") {
+                std::vector<std::string> keys =
                     read_string_collection(num_keys, std::cin, parser.get<bool>("verbose_output"));
+                build_dropping_duplicates(parser, keys);
             } else {
-                std::ifstream input(input_filename.c_str());
-                if (!input.good()) throw std::runtime_error("error in opening file.");
-                keys = read_string_collection(num_keys, input, parser.get<bool>("verbose_output"));
-                input.close();
+                uint64_t num_threads = std::min<uint64_t>(
+                    parser.parsed("num_threads") ? parser.get<uint64_t>("num_threads") : 1,
+                    std::thread::hardware_concurrency());
+                mapped_string_collection keys(input_filenames, num_keys, num_threads,
+                                              parser.get<bool>("verbose_output"));
+                build_dropping_duplicates(parser, keys);
+            }
+        } else {  // use num_keys random 64-bit keys
+            if (external_memory) {
+                std::cout << "Warning: external memory construction with in-memory input"
+                          << std::endl;
             }
+            std::vector<uint64_t> keys = distinct_keys<uint64_t>(num_keys, seed);
             build(parser, keys.begin(), keys.size());
         }
-    } else {  // use num_keys random 64-bit keys
-        if (external_memory) {
-            std::cout << "Warning: external memory construction with in-memory input" << std::endl;
-        }
-        std::vector<uint64_t> keys = distinct_keys<uint64_t>(num_keys, seed);
-        build(parser, keys.begin(), keys.size());
+    } catch (duplicate_keys_error const& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
     }
 
     return 0;
@@ -0,0 +1,202 @@
+#include <fcntl.h>         // for posix_fadvise
+#include <sys/resource.h>  // for getrusage
+#include <unistd.h>
+
+#include <iostream>
+#include <random>
+
+#include "external/cmd_line_parser/include/parser.hpp"
+#include "include/pthash.hpp"
+#include "src/util.hpp"
+
+using namespace pthash;
+
+/*
+    Lookup performance of a function freshly loaded from disk, as after a deploy or a restart.
+
+    The function (serialized by the build tool with -o) is loaded with read() calls.
+    Optionally, the file is first evicted from the page cache (--drop-caches).
+    Then the queries, in random order, are looked up in windows of geometrically increasing size
+    (1, 10, 100, ... queries) and, for each window, a JSON line reports the average lookup time
+    and the page faults (from getrusage) incurred by the window.
+    A final JSON line reports the load time, the time to first lookup (load + first lookup)
+    and the page faults incurred by the load.
+*/
+
+struct rusage_faults {
+    rusage_faults() {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        minor = usage.ru_minflt;
+        major = usage.ru_majflt;
+    }
+    uint64_t minor, major;
+};
+
+struct benchmark_parameters {
+    std::string function_filename;
+    bool drop_caches;
+};
+
+void drop_file_from_page_cache(std::string const& filename) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd == -1) throw std::runtime_error("cannot open '" + filename + "'");
+    ::fdatasync(fd);
+    int ret = ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+    if (ret != 0) throw std::runtime_error("posix_fadvise failed");
+}
+
+template <typename Function, typename Iterator>
+void benchmark(Iterator queries, uint64_t num_queries, benchmark_parameters const& params) {
+    if (params.drop_caches) drop_file_from_page_cache(params.function_filename);
+
+    Function f;
+    rusage_faults load_start_faults;
+    auto start = clock_type::now();
+    essentials::load(f, params.function_filename.c_str());
+    auto load_stop = clock_type::now();
+    rusage_faults load_stop_faults;
+    double load_nanosec = std::chrono::duration<double, std::nano>(load_stop - start).count();
+
+    uint64_t sum = 0;
+    uint64_t window_begin = 0;
+    double first_lookup_nanosec = 0;
+    for (uint64_t window_size = 1; window_begin != num_queries; window_size *= 10) {
+        uint64_t window_end = std::min(window_begin + window_size, num_queries);
+        rusage_faults window_start_faults;
+        auto window_start = clock_type::now();
+        Iterator it = queries + window_begin;
+        for (uint64_t i = window_begin; i != window_end; ++i, ++it) sum += f(*it);
+        auto window_stop = clock_type::now();
+        rusage_faults window_stop_faults;
+        double window_nanosec =
+            std::chrono::duration<double, std::nano>(window_stop - window_start).count();
+        if (window_begin == 0) first_lookup_nanosec = window_nanosec;
+
+        essentials::json_lines result;
+        result.add("window_begin", window_begin);
+        result.add("window_size", window_end - window_begin);
+        result.add("nanosec_per_key", window_nanosec / (window_end - window_begin));
+        result.add("minor_page_faults", window_stop_faults.minor - window_start_faults.minor);
+        result.add("major_page_faults", window_stop_faults.major - window_start_faults.major);
+        result.print_line();
+
+        window_begin = window_end;
+    }
+    essentials::do_not_optimize_away(sum);
+
+    essentials::json_lines result;
+    result.add("function_filename", params.function_filename.c_str());
+    result.add("encoder_type", Function::encoder_type::name().c_str());
+    result.add("num_keys", f.num_keys());
+    result.add("num_queries", num_queries);
+    result.add("drop_caches", params.drop_caches ? "true" : "false");
+    result.add("load_seconds", load_nanosec / 1000000000);
+    result.add("load_minor_page_faults", load_stop_faults.minor - load_start_faults.minor);
+    result.add("load_major_page_faults", load_stop_faults.major - load_start_faults.major);
+    result.add("first_lookup_nanosec", first_lookup_nanosec);
+    result.add("time_to_first_lookup_seconds", (load_nanosec + first_lookup_nanosec) / 1000000000);
+    result.print_line();
+}
+
+template <typename Hasher, typename Encoder, typename Iterator>
+void choose_phf(Iterator queries, uint64_t num_queries, bool partitioned, bool minimal,
+                benchmark_parameters const& params) {
+    if (partitioned) {
+        if (minimal) {
+            benchmark<partitioned_phf<Hasher, Encoder, true>>(queries, num_queries, params);
+        } else {
+            benchmark<partitioned_phf<Hasher, Encoder, false>>(queries, num_queries, params);
+        }
+    } else {
+        if (minimal) {
+            benchmark<single_phf<Hasher, Encoder, true>>(queries, num_queries, params);
+        } else {
+            benchmark<single_phf<Hasher, Encoder, false>>(queries, num_queries, params);
+        }
+    }
+}
+
+template <typename Hasher, typename Iterator>
+void choose_encoder(Iterator queries, uint64_t num_queries, std::string const& encoder_type,
+                    bool partitioned, bool minimal, benchmark_parameters const& params) {
+    bool found = encoder_type != "all" and for_each_encoder(encoder_type, [&](auto encoder) {
+        typedef typename decltype(encoder)::type Encoder;
+        choose_phf<Hasher, Encoder>(queries, num_queries, partitioned, minimal, params);
+    });
+    if (!found) std::cerr << "unknown encoder type" << std::endl;
+}
+
+template <typename Iterator>
+void run(cmd_line_parser::parser const& parser, Iterator queries, uint64_t num_keys,
+         uint64_t num_queries) {
+    benchmark_parameters params;
+    params.function_filename = parser.get<std::string>("function_filename");
+    params.drop_caches = parser.get<bool>("drop_caches");
+    auto encoder_type = parser.get<std::string>("encoder_type");
+    bool partitioned = parser.get<bool>("partitioned");
+    bool minimal = parser.get<bool>("minimal_output");
+    // same choice as the build tool
+    if (num_keys <= (uint64_t(1) << 30)) {
+        choose_encoder<murmurhash2_64>(queries, num_queries, encoder_type, partitioned, minimal,
+                                       params);
+    } else {
+        choose_encoder<murmurhash2_128>(queries, num_queries, encoder_type, partitioned, minimal,
+                                        params);
+    }
+}
+
+int main(int argc, char** argv) {
+    cmd_line_parser::parser parser(argc, argv);
+    parser.add("function_filename", "A function serialized with the build tool (option -o).",
+               "-f", true);
+    parser.add("num_keys", "The number of keys the function was built on.", "-n", true);
+    parser.add("encoder_type",
+               "The encoder type the function was built with: one of " + encoder_names_list() +
+                   ".",
+               "-e", true);
+    parser.add("input_filename",
+               "The string keys the function was built on. If this is not provided, then "
+               "num_keys 64-bit random keys, generated with the given seed, are used instead.",
+               "-i", false);
+    parser.add("seed", "Seed used to generate the random keys at construction.", "-s", false);
+    parser.add("num_queries", "Number of lookups. Default is num_keys.", "-q", false);
+    parser.add("partitioned", "The function is partitioned (built with -p > 1).", "--partitioned",
+               false, true);
+    parser.add("minimal_output", "The function is minimal.", "--minimal", false, true);
+    parser.add("drop_caches", "Evict the function file from the page cache before loading.",
+               "--drop-caches", false, true);
+    if (!parser.parse()) return 1;
+
+    auto num_keys = parser.get<uint64_t>("num_keys");
+    uint64_t num_queries =
+        parser.parsed("num_queries") ? parser.get<uint64_t>("num_queries") : num_keys;
+    std::mt19937_64 gen(num_queries);
+
+    if (parser.parsed("input_filename")) {
+        auto input_filename = parser.get<std::string>("input_filename");
+        std::ifstream input(input_filename.c_str());
+        if (!input.good()) throw std::runtime_error("error in opening file.");
+        std::vector<std::string> keys = read_string_collection(num_keys, input, false);
+        input.close();
+        std::vector<std::string> queries(num_queries);
+        for (auto& q : queries) q = keys[gen() % keys.size()];
+        std::vector<std::string>().swap(keys);
+        run(parser, queries.begin(), num_keys, num_queries);
+    } else {
+        if (!parser.parsed("seed")) {
+            std::cerr << "the seed used at construction is needed to generate the keys"
+                      << std::endl;
+            return 1;
+        }
+        std::vector<uint64_t> keys =
+            distinct_keys<uint64_t>(num_keys, parser.get<uint64_t>("seed"));
+        std::vector<uint64_t> queries(num_queries);
+        for (auto& q : queries) q = keys[gen() % keys.size()];
+        std::vector<uint64_t>().swap(keys);
+        run(parser, queries.begin(), num_keys, num_queries);
+    }
+
+    return 0;
+}
@@ -0,0 +1,182 @@
+#include <iostream>
+#include <random>
+
+#include "external/cmd_line_parser/include/parser.hpp"
+#include "include/pthash.hpp"
+#include "src/util.hpp"
+
+using namespace pthash;
+
+/*
+    Benchmark of the encoders in isolation, on the pilots of a real build (default)
+    or on pilots drawn from a geometric distribution with the given mean.
+    One JSON line per encoder is printed, with: encoding throughput, bits per value,
+    random access, sequential decoding and batched (sorted) access times.
+*/
+
+struct benchmark_parameters {
+    std::string source;
+    uint64_t num_keys;
+    double c;
+    double alpha;
+    double mean;
+    uint64_t num_queries;
+    uint64_t runs;
+    uint64_t seed;
+};
+
+static constexpr uint64_t access_batch_size = 1024;
+
+template <typename Encoder>
+void benchmark(std::vector<uint64_t> const& pilots, std::vector<uint64_t> const& queries,
+               benchmark_parameters const& params) {
+    uint64_t n = pilots.size();
+    uint64_t num_queries = queries.size();
+    Encoder encoder;
+    essentials::timer<std::chrono::high_resolution_clock, std::chrono::nanoseconds> t;
+
+    for (uint64_t r = 0; r != params.runs; ++r) {
+        Encoder e;
+        t.start();
+        e.encode(pilots.begin(), n);
+        t.stop();
+        if (r == 0) std::swap(encoder, e);
+    }
+    double encoding_seconds = t.average() / 1000000000;
+
+    for (uint64_t i = 0; i != n; ++i) {
+        if (encoder.access(i) != pilots[i]) {
+            std::cerr << Encoder::name() << ": wrong value at position " << i << std::endl;
+            return;
+        }
+    }
+
+    uint64_t sum = 0;
+
+    t.reset();
+    t.start();
+    for (uint64_t r = 0; r != params.runs; ++r) {
+        for (auto i : queries) sum += encoder.access(i);
+    }
+    t.stop();
+    double random_ns = t.elapsed() / (params.runs * num_queries);
+    essentials::do_not_optimize_away(sum);
+
+    t.reset();
+    t.start();
+    for (uint64_t r = 0; r != params.runs; ++r) {
+        for (uint64_t i = 0; i != n; ++i) sum += encoder.access(i);
+    }
+    t.stop();
+    double sequential_ns = t.elapsed() / (params.runs * n);
+    essentials::do_not_optimize_away(sum);
+
+    /* same queries as in random access, sorted in batches of access_batch_size */
+    std::vector<uint64_t> batched_queries = queries;
+    for (uint64_t i = 0; i < num_queries; i += access_batch_size) {
+        auto end = batched_queries.begin() + std::min(i + access_batch_size, num_queries);
+        std::sort(batched_queries.begin() + i, end);
+    }
+    t.reset();
+    t.start();
+    for (uint64_t r = 0; r != params.runs; ++r) {
+        for (auto i : batched_queries) sum += encoder.access(i);
+    }
+    t.stop();
+    double batched_ns = t.elapsed() / (params.runs * num_queries);
+    essentials::do_not_optimize_away(sum);
+
+    essentials::json_lines result;
+    result.add("encoder_type", Encoder::name().c_str());
+    result.add("source", params.source.c_str());
+    if (params.source == "build") {
+        result.add("n", params.num_keys);
+        result.add("c", params.c);
+        result.add("alpha", params.alpha);
+    } else {
+        result.add("mean", params.mean);
+    }
+    result.add("num_values", n);
+    result.add("encoding_seconds", encoding_seconds);
+    result.add("encoding_mvalues_per_second", n / encoding_seconds / 1000000);
+    result.add("bits_per_value", static_cast<double>(encoder.num_bits()) / n);
+    result.add("random_access_nanosec", random_ns);
+    result.add("sequential_access_nanosec", sequential_ns);
+    result.add("batched_access_nanosec", batched_ns);
+    result.print_line();
+}
+
+int main(int argc, char** argv) {
+    cmd_line_parser::parser parser(argc, argv);
+    parser.add("num_keys",
+               "Number of keys of the build whose pilots are encoded, or number of pilots "
+               "when using --geometric.",
+               "-n", true);
+    parser.add("encoder_type",
+               "The encoder type. Possibile values are: " + encoder_names_list() +
+                   ", 'all'. Default is 'all'.",
+               "-e", false);
+    parser.add("c", "A constant that trades construction speed for space effectiveness.", "-c",
+               false);
+    parser.add("alpha", "The table load factor. It must be a quantity > 0 and <= 1.", "-a",
+               false);
+    parser.add("mean", "Mean of the geometric distribution (with --geometric).", "-m", false);
+    parser.add("num_queries", "Number of random accesses. Default is 1000000.", "-q", false);
+    parser.add("runs", "Number of runs of each measurement. Default is 5.", "-r", false);
+    parser.add("seed", "Seed for the keys, the build and the queries.", "-s", false);
+    parser.add("geometric", "Use geometrically-distributed pilots instead of a real build.",
+               "--geometric", false, true);
+    if (!parser.parse()) return 1;
+
+    benchmark_parameters params;
+    params.source = parser.get<bool>("geometric") ? "geometric" : "build";
+    params.num_keys = parser.get<uint64_t>("num_keys");
+    params.c = parser.parsed("c") ? parser.get<double>("c") : 7.0;
+    params.alpha = parser.parsed("alpha") ? parser.get<double>("alpha") : 0.99;
+    params.mean = parser.parsed("mean") ? parser.get<double>("mean") : 100.0;
+    params.num_queries =
+        parser.parsed("num_queries") ? parser.get<uint64_t>("num_queries") : 1000000;
+    params.runs = parser.parsed("runs") ? parser.get<uint64_t>("runs") : 5;
+    params.seed = parser.parsed("seed") ? parser.get<uint64_t>("seed") : 1234567890;
+    std::string encoder_type = parser.parsed("encoder_type")
+                                   ? parser.get<std::string>("encoder_type")
+                                   : std::string("all");
+    if (params.runs == 0) params.runs = 1;
+    if (!for_each_encoder(encoder_type, [](auto) {})) {
+        std::cerr << "unknown encoder type" << std::endl;
+        return 1;
+    }
+
+    std::mt19937_64 gen(params.seed);
+    std::vector<uint64_t> pilots;
+    if (params.source == "build") {
+        essentials::logger("building on " + std::to_string(params.num_keys) + " keys...");
+        std::vector<uint64_t> keys = distinct_keys<uint64_t>(params.num_keys, params.seed);
+        build_configuration config;
+        config.c = params.c;
+        config.alpha = params.alpha;
+        config.minimal_output = true;
+        config.verbose_output = false;
+        config.seed = params.seed;
+        internal_memory_builder_single_phf<murmurhash2_64> builder;
+        builder.build_from_keys(keys.begin(), keys.size(), config);
+        pilots = builder.pilots();
+    } else {
+        std::geometric_distribution<uint64_t> pilot(1.0 / (params.mean + 1.0));
+        pilots.resize(params.num_keys);
+        for (auto& p : pilots) p = pilot(gen);
+    }
+    if (pilots.empty()) {
+        std::cerr << "no pilots to encode" << std::endl;
+        return 1;
+    }
+
+    std::vector<uint64_t> queries(params.num_queries);
+    std::uniform_int_distribution<uint64_t> position(0, pilots.size() - 1);
+    for (auto& q : queries) q = position(gen);
+
+    for_each_encoder(encoder_type, [&](auto encoder) {
+        benchmark<typename decltype(encoder)::type>(pilots, queries, params);
+    });
+    return 0;
+}
@@ -42,6 +42,7 @@ int main() {
     auto start = clock_type::now();
     auto timings = f.build_in_internal_memory(keys.begin(), keys.size(), config);
     // auto timings = f.build_in_external_memory(keys.begin(), keys.size(), config);
+    // auto timings = f.build(keys.begin(), keys.size(), config);  // internal or external
     double total_seconds = timings.partitioning_seconds + timings.mapping_ordering_seconds +
                            timings.searching_seconds + timings.encoding_seconds;
     std::cout << "function built in " << seconds(clock_type::now() - start) << " seconds"
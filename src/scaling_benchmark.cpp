@@ -0,0 +1,294 @@
+#include <iostream>
+#include <thread>
+
+#include "external/cmd_line_parser/include/parser.hpp"
+#include "include/pthash.hpp"
+#include "src/util.hpp"
+
+using namespace pthash;
+
+/*
+    Build the same key set with every combination of number of threads, number of partitions,
+    internal/external memory and (for external memory) RAM budget, in a single process.
+    The keys are loaded once and, for internal-memory constructions, also hashed once
+    (so the internal-memory timings do not include hashing: see "hashing_seconds").
+    One JSON line is printed per configuration, with the time of each phase,
+    and the speedup and parallel efficiency with respect to the run with the fewest threads
+    of the same (memory, ram, num_partitions) series.
+*/
+
+struct scaling_parameters {
+    std::vector<uint64_t> num_threads;
+    std::vector<uint64_t> num_partitions;
+    std::vector<bool> external_memory;
+    std::vector<uint64_t> ram;
+    std::string encoder_type;
+    uint64_t runs;
+};
+
+template <typename Function, typename Builder>
+double encode(Builder& builder, build_configuration const& config) {
+    Function f;
+    return f.build(builder, config);
+}
+
+template <bool partitioned, typename Encoder, typename Builder>
+double encode(Builder& builder, build_configuration const& config) {
+    typedef typename Builder::hasher_type hasher_type;
+    if constexpr (partitioned) {
+        return encode<partitioned_phf<hasher_type, Encoder, true>>(builder, config);
+    } else {
+        return encode<single_phf<hasher_type, Encoder, true>>(builder, config);
+    }
+}
+
+template <bool partitioned, typename Builder>
+double encode(Builder& builder, std::string const& encoder_type,
+              build_configuration const& config) {
+    double encoding_seconds = 0.0;
+    for_each_encoder(encoder_type, [&](auto encoder) {
+        typedef typename decltype(encoder)::type Encoder;
+        encoding_seconds = encode<partitioned, Encoder>(builder, config);
+    });
+    return encoding_seconds;
+}
+
+template <typename Hasher, typename Iterator>
+build_timings build_once(Iterator keys, std::vector<typename Hasher::hash_type> const& hashes,
+                         uint64_t num_keys, bool external_memory, std::string const& encoder_type,
+                         build_configuration const& config) {
+    build_timings timings;
+    if (config.num_partitions > 1) {
+        if (external_memory) {
+            external_memory_builder_partitioned_phf<Hasher> builder;
+            timings = builder.build_from_keys(keys, num_keys, config);
+            timings.encoding_seconds = encode<true>(builder, encoder_type, config);
+        } else {
+            internal_memory_builder_partitioned_phf<Hasher> builder;
+            timings = builder.build_from_hashes(hashes.begin(), num_keys, config);
+            timings.encoding_seconds = encode<true>(builder, encoder_type, config);
+        }
+    } else {
+        if (external_memory) {
+            external_memory_builder_single_phf<Hasher> builder;
+            timings = builder.build_from_keys(keys, num_keys, config);
+            timings.encoding_seconds = encode<false>(builder, encoder_type, config);
+        } else {
+            internal_memory_builder_single_phf<Hasher> builder;
+            timings = builder.build_from_hashes(hashes.begin(), num_keys, config);
+            timings.encoding_seconds = encode<false>(builder, encoder_type, config);
+        }
+    }
+    return timings;
+}
+
+template <typename Hasher, typename Iterator>
+void run(Iterator keys, uint64_t num_keys, scaling_parameters const& params,
+         build_configuration const& base_config) {
+    std::vector<typename Hasher::hash_type> hashes;
+    double hashing_seconds = 0.0;
+    if (!params.external_memory.front()) {
+        essentials::logger("hashing " + std::to_string(num_keys) + " keys...");
+        auto start = clock_type::now();
+        hashes.reserve(num_keys);
+        Iterator it = keys;
+        for (uint64_t i = 0; i != num_keys; ++i, ++it) {
+            hashes.push_back(Hasher::hash(*it, base_config.seed));
+        }
+        hashing_seconds = seconds(clock_type::now() - start);
+    }
+
+    for (bool external_memory : params.external_memory) {
+        std::vector<uint64_t> rams = {base_config.ram};
+        if (external_memory and !params.ram.empty()) rams = params.ram;
+        // hashes are only used by internal-memory constructions, which come first
+        if (external_memory) std::vector<typename Hasher::hash_type>().swap(hashes);
+
+        for (uint64_t ram : rams) {
+            for (uint64_t num_partitions : params.num_partitions) {
+                uint64_t base_num_threads = 0;
+                double base_total_seconds = 0.0;
+
+                for (uint64_t num_threads : params.num_threads) {
+                    build_configuration config = base_config;
+                    config.num_partitions = num_partitions;
+                    config.num_threads = num_threads;
+                    config.ram = ram;
+
+                    build_timings timings;
+                    try {
+                        for (uint64_t r = 0; r != params.runs; ++r) {
+                            essentials::logger(
+                                std::string(external_memory ? "external" : "internal") +
+                                " memory, " + std::to_string(num_partitions) + " partitions, " +
+                                std::to_string(num_threads) + " threads (run " +
+                                std::to_string(r + 1) + "/" + std::to_string(params.runs) + ")");
+                            auto t = build_once<Hasher>(keys, hashes, num_keys, external_memory,
+                                                        params.encoder_type, config);
+                            timings.partitioning_seconds += t.partitioning_seconds;
+                            timings.mapping_ordering_seconds += t.mapping_ordering_seconds;
+                            timings.searching_seconds += t.searching_seconds;
+                            timings.encoding_seconds += t.encoding_seconds;
+                        }
+                    } catch (std::exception const& e) {
+                        std::cout << "skipping configuration: " << e.what() << std::endl;
+                        continue;
+                    }
+                    timings.partitioning_seconds /= params.runs;
+                    timings.mapping_ordering_seconds /= params.runs;
+                    timings.searching_seconds /= params.runs;
+                    timings.encoding_seconds /= params.runs;
+                    double total_seconds =
+                        timings.partitioning_seconds + timings.mapping_ordering_seconds +
+                        timings.searching_seconds + timings.encoding_seconds;
+
+                    if (base_num_threads == 0) {
+                        base_num_threads = num_threads;
+                        base_total_seconds = total_seconds;
+                    }
+                    double speedup = base_total_seconds / total_seconds;
+                    double efficiency =
+                        speedup * base_num_threads / static_cast<double>(num_threads);
+
+                    essentials::json_lines result;
+                    result.add("n", num_keys);
+                    result.add("c", config.c);
+                    result.add("alpha", config.alpha);
+                    result.add("encoder_type", params.encoder_type.c_str());
+                    result.add("num_partitions", num_partitions);
+                    result.add("num_threads", num_threads);
+                    result.add("external_memory", external_memory ? "true" : "false");
+                    if (external_memory) result.add("ram", ram);
+                    result.add("seed", config.seed);
+                    result.add("runs", params.runs);
+                    if (!external_memory) result.add("hashing_seconds", hashing_seconds);
+                    result.add("partitioning_seconds", timings.partitioning_seconds);
+                    result.add("mapping_ordering_seconds", timings.mapping_ordering_seconds);
+                    result.add("searching_seconds", timings.searching_seconds);
+                    result.add("encoding_seconds", timings.encoding_seconds);
+                    result.add("total_seconds", total_seconds);
+                    result.add("speedup", speedup);
+                    result.add("parallel_efficiency", efficiency);
+                    result.print_line();
+                }
+            }
+        }
+    }
+}
+
+template <typename Iterator>
+void run(Iterator keys, uint64_t num_keys, scaling_parameters const& params,
+         build_configuration const& config) {
+    if (num_keys <= (uint64_t(1) << 30)) {
+        run<murmurhash2_64>(keys, num_keys, params, config);
+    } else {
+        run<murmurhash2_128>(keys, num_keys, params, config);
+    }
+}
+
+int main(int argc, char** argv) {
+    cmd_line_parser::parser parser(argc, argv);
+    parser.add("num_keys", "The size of the input.", "-n", true);
+    parser.add("c",
+               "A constant that trades construction speed for space effectiveness. "
+               "A reasonable value lies between 3.0 and 10.0.",
+               "-c", true);
+    parser.add("alpha", "The table load factor. It must be a quantity > 0 and <= 1.", "-a", true);
+    parser.add("encoder_type",
+               "The encoder type. Possibile values are: " + encoder_names_list() +
+                   ". Default is 'dictionary_dictionary'.",
+               "-e", false);
+    parser.add("num_threads", "Comma-separated list of numbers of threads. Default is '1'.", "-t",
+               false);
+    parser.add("num_partitions", "Comma-separated list of numbers of partitions. Default is '1'.",
+               "-p", false);
+    parser.add("memory",
+               "Comma-separated list of construction modes among 'internal' and 'external'. "
+               "Default is 'internal'.",
+               "-M", false);
+    parser.add("ram",
+               "Comma-separated list of Giga bytes of RAM to use for construction in external "
+               "memory.",
+               "-m", false);
+    parser.add("runs", "Number of runs of each configuration. Default is 1.", "-r", false);
+    parser.add("seed", "Seed to use for construction.", "-s", false);
+    parser.add("input_filename",
+               "A string input file name. If this is not provided, then num_keys 64-bit random "
+               "keys will be used as input instead.",
+               "-i", false);
+    parser.add("tmp_dir",
+               "Temporary directory used for building in external memory. Default is directory '" +
+                   constants::default_tmp_dirname + "'.",
+               "-d", false);
+    if (!parser.parse()) return 1;
+
+    scaling_parameters params;
+    params.encoder_type = parser.parsed("encoder_type") ? parser.get<std::string>("encoder_type")
+                                                        : std::string("dictionary_dictionary");
+    if (params.encoder_type == "all" or !for_each_encoder(params.encoder_type, [](auto) {})) {
+        std::cerr << "unknown encoder type" << std::endl;
+        return 1;
+    }
+    params.runs = parser.parsed("runs") ? parser.get<uint64_t>("runs") : 1;
+    if (params.runs == 0) params.runs = 1;
+
+    auto to_uint = [](std::string const& list) {
+        std::vector<uint64_t> values;
+        for (auto const& value : split(list)) values.push_back(std::stoull(value));
+        return values;
+    };
+    params.num_threads =
+        parser.parsed("num_threads") ? to_uint(parser.get<std::string>("num_threads"))
+                                     : std::vector<uint64_t>{1};
+    params.num_partitions =
+        parser.parsed("num_partitions") ? to_uint(parser.get<std::string>("num_partitions"))
+                                        : std::vector<uint64_t>{1};
+    std::sort(params.num_threads.begin(), params.num_threads.end());
+    if (params.num_threads.empty() or params.num_threads.front() == 0 or
+        params.num_partitions.empty()) {
+        std::cerr << "invalid number of threads or partitions" << std::endl;
+        return 1;
+    }
+    bool internal = false, external = false;
+    for (auto const& mode :
+         split(parser.parsed("memory") ? parser.get<std::string>("memory") : "internal")) {
+        if (mode != "internal" and mode != "external") {
+            std::cerr << "unknown memory mode '" << mode << "'" << std::endl;
+            return 1;
+        }
+        internal |= (mode == "internal");
+        external |= (mode == "external");
+    }
+    // run internal-memory constructions first, while the hashes are in memory
+    if (internal) params.external_memory.push_back(false);
+    if (external) params.external_memory.push_back(true);
+    if (parser.parsed("ram")) {
+        constexpr uint64_t GB = 1000000000;
+        for (auto const& value : split(parser.get<std::string>("ram"))) {
+            params.ram.push_back(std::stod(value) * GB);
+        }
+    }
+
+    build_configuration config;
+    config.c = parser.get<double>("c");
+    config.alpha = parser.get<double>("alpha");
+    config.minimal_output = true;
+    config.verbose_output = false;
+    config.seed = parser.parsed("seed") ? parser.get<uint64_t>("seed") : random_value();
+    if (parser.parsed("tmp_dir")) config.tmp_dir = parser.get<std::string>("tmp_dir");
+
+    auto num_keys = parser.get<uint64_t>("num_keys");
+    if (parser.parsed("input_filename")) {
+        auto input_filename = parser.get<std::string>("input_filename");
+        std::ifstream input(input_filename.c_str());
+        if (!input.good()) throw std::runtime_error("error in opening file.");
+        std::vector<std::string> keys = read_string_collection(num_keys, input, true);
+        input.close();
+        run(keys.begin(), keys.size(), params, config);
+    } else {
+        std::vector<uint64_t> keys = distinct_keys<uint64_t>(num_keys, config.seed);
+        run(keys.begin(), keys.size(), params, config);
+    }
+
+    return 0;
+}
@@ -0,0 +1,184 @@
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+#include "external/cmd_line_parser/include/parser.hpp"
+#include "include/pthash.hpp"
+#include "src/util.hpp"
+
+using namespace pthash;
+
+/*
+    Space breakdown of a function serialized with the build tool (option -o).
+
+    Prints JSON lines with:
+    - a summary of the function (keys, table size, buckets, partitions, bits per key);
+    - one line per component (see space_auditor), in pre-order: the space of a component
+      includes the space of its sub-components. For partitioned functions, the components
+      of the partitions are summed over all the partitions;
+    - the histogram of the pilot values, in power-of-two classes;
+    - for partitioned functions, the partition sizes and the per-partition overhead.
+
+    The hasher is not part of the serialized data, so the layout only depends on
+    the encoder type and on the function being partitioned or not.
+*/
+
+template <typename Function>
+struct is_partitioned : std::false_type {};
+template <typename Hasher, typename Encoder, bool Minimal>
+struct is_partitioned<partitioned_phf<Hasher, Encoder, Minimal>> : std::true_type {};
+
+void print_pilots_histogram(std::vector<uint64_t> const& histogram, uint64_t num_buckets) {
+    for (uint64_t k = 0; k != histogram.size(); ++k) {
+        if (histogram[k] == 0) continue;
+        essentials::json_lines result;
+        result.add("pilots_from", k == 0 ? 0 : uint64_t(1) << (k - 1));
+        result.add("pilots_to", uint64_t(1) << k);
+        result.add("num_buckets", histogram[k]);
+        result.add("percentage", histogram[k] * 100.0 / num_buckets);
+        result.print_line();
+    }
+}
+
+template <typename SinglePHF>
+void add_pilots(SinglePHF const& f, std::vector<uint64_t>& histogram) {
+    for (uint64_t b = 0; b != f.num_buckets(); ++b) {
+        uint64_t pilot = f.pilot(b);
+        histogram[pilot == 0 ? 0 : 64 - __builtin_clzll(pilot)] += 1;
+    }
+}
+
+template <typename Function>
+void audit(std::string const& function_filename) {
+    Function f;
+    uint64_t bytes = essentials::load(f, function_filename.c_str());
+    {
+        std::ifstream in(function_filename.c_str(), std::ifstream::binary | std::ifstream::ate);
+        if (static_cast<uint64_t>(in.tellg()) != bytes) {
+            throw std::runtime_error("the function type does not match the file");
+        }
+    }
+
+    space_auditor auditor;
+    f.audit(auditor);
+    assert(auditor.total_bits() == f.num_bits());
+    uint64_t num_keys = f.num_keys();
+
+    std::vector<uint64_t> histogram(65, 0);
+    uint64_t num_buckets = 0;
+    uint64_t num_partitions = 1;
+    if constexpr (is_partitioned<Function>::value) {
+        num_partitions = f.num_partitions();
+        for (uint64_t i = 0; i != num_partitions; ++i) {
+            add_pilots(f.partition_function(i), histogram);
+            num_buckets += f.partition_function(i).num_buckets();
+        }
+    } else {
+        add_pilots(f, histogram);
+        num_buckets = f.num_buckets();
+    }
+
+    essentials::json_lines result;
+    result.add("function_filename", function_filename.c_str());
+    result.add("encoder_type", Function::encoder_type::name().c_str());
+    result.add("minimal", Function::minimal ? "true" : "false");
+    result.add("num_keys", num_keys);
+    result.add("table_size", f.table_size());
+    result.add("num_buckets", num_buckets);
+    result.add("num_partitions", num_partitions);
+    result.add("bytes", bytes);
+    result.add("bits", auditor.total_bits());
+    result.add("bits_per_key", static_cast<double>(auditor.total_bits()) / num_keys);
+    result.print_line();
+
+    for (auto const& e : auditor.entries()) {
+        essentials::json_lines component;
+        component.add("component", e.path.c_str());
+        component.add("bits", e.bits);
+        component.add("bits_per_key", static_cast<double>(e.bits) / num_keys);
+        component.add("percentage", e.bits * 100.0 / auditor.total_bits());
+        if (e.count > 1) component.add("count", e.count);
+        component.print_line();
+    }
+
+    print_pilots_histogram(histogram, num_buckets);
+
+    if constexpr (is_partitioned<Function>::value) {
+        uint64_t min_size = uint64_t(-1), max_size = 0;
+        double mean = static_cast<double>(num_keys) / num_partitions, variance = 0;
+        for (uint64_t i = 0; i != num_partitions; ++i) {
+            uint64_t size = f.partition_function(i).num_keys();
+            min_size = std::min(min_size, size);
+            max_size = std::max(max_size, size);
+            variance += (size - mean) * (size - mean);
+        }
+        variance /= num_partitions;
+
+        /* everything that is replicated in each partition, besides pilots and free slots */
+        uint64_t overhead_bits = 0;
+        for (auto const& e : auditor.entries()) {
+            if (e.path == "partitions/offset" or e.path == "partitions/parameters" or
+                e.path == "partitions/bucketer") {
+                overhead_bits += e.bits;
+            }
+        }
+
+        essentials::json_lines partitions;
+        partitions.add("num_partitions", num_partitions);
+        partitions.add("min_partition_size", min_size);
+        partitions.add("max_partition_size", max_size);
+        partitions.add("avg_partition_size", mean);
+        partitions.add("stddev_partition_size", std::sqrt(variance));
+        partitions.add("max_over_avg_partition_size", max_size / mean);
+        partitions.add("overhead_bits_per_partition",
+                       static_cast<double>(overhead_bits) / num_partitions);
+        partitions.add("overhead_bits_per_key", static_cast<double>(overhead_bits) / num_keys);
+        partitions.print_line();
+    }
+}
+
+template <typename Encoder>
+void choose_phf(std::string const& function_filename, bool partitioned, bool minimal) {
+    if (partitioned) {
+        if (minimal) {
+            audit<partitioned_phf<murmurhash2_64, Encoder, true>>(function_filename);
+        } else {
+            audit<partitioned_phf<murmurhash2_64, Encoder, false>>(function_filename);
+        }
+    } else {
+        if (minimal) {
+            audit<single_phf<murmurhash2_64, Encoder, true>>(function_filename);
+        } else {
+            audit<single_phf<murmurhash2_64, Encoder, false>>(function_filename);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    cmd_line_parser::parser parser(argc, argv);
+    parser.add("function_filename", "A function serialized with the build tool (option -o).",
+               "-f", true);
+    parser.add("encoder_type",
+               "The encoder type the function was built with: one of " + encoder_names_list() +
+                   ".",
+               "-e", true);
+    parser.add("partitioned", "The function is partitioned (built with -p > 1).", "--partitioned",
+               false, true);
+    parser.add("minimal_output", "The function is minimal.", "--minimal", false, true);
+    if (!parser.parse()) return 1;
+
+    auto function_filename = parser.get<std::string>("function_filename");
+    auto encoder_type = parser.get<std::string>("encoder_type");
+    bool partitioned = parser.get<bool>("partitioned");
+    bool minimal = parser.get<bool>("minimal_output");
+
+    bool found = encoder_type != "all" and for_each_encoder(encoder_type, [&](auto encoder) {
+        choose_phf<typename decltype(encoder)::type>(function_filename, partitioned, minimal);
+    });
+    if (!found) {
+        std::cerr << "unknown encoder type" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
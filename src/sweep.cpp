@@ -0,0 +1,243 @@
+#include <iostream>
+#include <thread>
+
+#include "external/cmd_line_parser/include/parser.hpp"
+#include "include/pthash.hpp"
+#include "src/util.hpp"
+
+using namespace pthash;
+
+/*
+    Build the same key set with every combination of the comma-separated lists of
+    c values, load factors, numbers of partitions and encoders, in a single process
+    (internal memory only).
+    The keys are loaded and hashed once: every construction starts from the same hashes
+    (build_from_hashes), and the pilots found for a (c, alpha, num_partitions) point are
+    encoded with all the encoders, so the search runs once per point rather than
+    once per encoder.
+    One JSON line is printed per (c, alpha, num_partitions, encoder) point, with the build time,
+    the space and (with --lookup) the lookup time: these are the coordinates of
+    the space/time trade-off plots.
+*/
+
+struct sweep_parameters {
+    std::vector<double> c;
+    std::vector<double> alpha;
+    std::vector<uint64_t> num_partitions;
+    std::vector<std::string> encoder_types;
+    bool check, lookup;
+};
+
+template <typename Function, typename Builder, typename Iterator>
+void sweep_point(Builder const& builder, build_timings const& timings, Iterator keys,
+                 uint64_t num_keys, double hashing_seconds, sweep_parameters const& params,
+                 build_configuration const& config) {
+    Function f;
+    double encoding_seconds = f.build(builder, config);
+    double total_seconds = timings.partitioning_seconds + timings.mapping_ordering_seconds +
+                           timings.searching_seconds + encoding_seconds;
+
+    if (params.check and !check(keys, f, config.num_threads)) {
+        throw std::runtime_error("the function built for c = " + std::to_string(config.c) +
+                                 ", alpha = " + std::to_string(config.alpha) + " is not correct");
+    }
+    double nanosec_per_key = params.lookup ? perf(keys, num_keys, f) : 0.0;
+
+    essentials::json_lines result;
+    result.add("n", num_keys);
+    result.add("c", config.c);
+    result.add("alpha", config.alpha);
+    result.add("minimal", config.minimal_output ? "true" : "false");
+    result.add("encoder_type", Function::encoder_type::name().c_str());
+    result.add("num_partitions", config.num_partitions);
+    result.add("num_threads", config.num_threads);
+    result.add("seed", config.seed);
+    result.add("hashing_seconds", hashing_seconds);
+    result.add("partitioning_seconds", timings.partitioning_seconds);
+    result.add("mapping_ordering_seconds", timings.mapping_ordering_seconds);
+    result.add("searching_seconds", timings.searching_seconds);
+    result.add("encoding_seconds", encoding_seconds);
+    result.add("total_seconds", total_seconds);
+    result.add("pt_bits_per_key", static_cast<double>(f.num_bits_for_pilots()) / f.num_keys());
+    result.add("mapper_bits_per_key", static_cast<double>(f.num_bits_for_mapper()) / f.num_keys());
+    result.add("bits_per_key", static_cast<double>(f.num_bits()) / f.num_keys());
+    if (params.lookup) result.add("nanosec_per_key", nanosec_per_key);
+    result.print_line();
+}
+
+template <bool partitioned, typename Encoder, typename Builder, typename Iterator>
+void choose_phf(Builder const& builder, build_timings const& timings, Iterator keys,
+                uint64_t num_keys, double hashing_seconds, sweep_parameters const& params,
+                build_configuration const& config) {
+    typedef typename Builder::hasher_type hasher_type;
+    if constexpr (partitioned) {
+        if (config.minimal_output) {
+            sweep_point<partitioned_phf<hasher_type, Encoder, true>>(
+                builder, timings, keys, num_keys, hashing_seconds, params, config);
+        } else {
+            sweep_point<partitioned_phf<hasher_type, Encoder, false>>(
+                builder, timings, keys, num_keys, hashing_seconds, params, config);
+        }
+    } else {
+        if (config.minimal_output) {
+            sweep_point<single_phf<hasher_type, Encoder, true>>(builder, timings, keys, num_keys,
+                                                                hashing_seconds, params, config);
+        } else {
+            sweep_point<single_phf<hasher_type, Encoder, false>>(builder, timings, keys, num_keys,
+                                                                 hashing_seconds, params, config);
+        }
+    }
+}
+
+template <bool partitioned, typename Builder, typename Iterator>
+void encode_all(Builder const& builder, build_timings const& timings, Iterator keys,
+                uint64_t num_keys, double hashing_seconds, sweep_parameters const& params,
+                build_configuration const& config) {
+    for (auto const& encoder_type : params.encoder_types) {
+        for_each_encoder(encoder_type, [&](auto encoder) {
+            typedef typename decltype(encoder)::type Encoder;
+            choose_phf<partitioned, Encoder>(builder, timings, keys, num_keys, hashing_seconds,
+                                             params, config);
+        });
+    }
+}
+
+template <typename Hasher, typename Iterator>
+void sweep(Iterator keys, uint64_t num_keys, sweep_parameters const& params,
+           build_configuration const& base_config) {
+    essentials::logger("hashing " + std::to_string(num_keys) + " keys...");
+    auto start = clock_type::now();
+    std::vector<typename Hasher::hash_type> hashes;
+    hashes.reserve(num_keys);
+    {
+        Iterator it = keys;
+        for (uint64_t i = 0; i != num_keys; ++i, ++it) {
+            hashes.push_back(Hasher::hash(*it, base_config.seed));
+        }
+    }
+    double hashing_seconds = seconds(clock_type::now() - start);
+
+    for (uint64_t num_partitions : params.num_partitions) {
+        for (double c : params.c) {
+            for (double alpha : params.alpha) {
+                build_configuration config = base_config;
+                config.c = c;
+                config.alpha = alpha;
+                config.num_partitions = num_partitions;
+                essentials::logger("c = " + std::to_string(c) + ", alpha = " +
+                                   std::to_string(alpha) + ", " +
+                                   std::to_string(num_partitions) + " partitions");
+                try {
+                    if (num_partitions > 1) {
+                        internal_memory_builder_partitioned_phf<Hasher> builder;
+                        auto timings = builder.build_from_hashes(hashes.begin(), num_keys, config);
+                        encode_all<true>(builder, timings, keys, num_keys, hashing_seconds,
+                                         params, config);
+                    } else {
+                        internal_memory_builder_single_phf<Hasher> builder;
+                        auto timings = builder.build_from_hashes(hashes.begin(), num_keys, config);
+                        encode_all<false>(builder, timings, keys, num_keys, hashing_seconds,
+                                          params, config);
+                    }
+                } catch (seed_runtime_error const& e) {
+                    /* the hashes are fixed, so the seed cannot be changed for this point alone */
+                    std::cout << "skipping configuration: " << e.what() << std::endl;
+                }
+            }
+        }
+    }
+}
+
+template <typename Iterator>
+void sweep(Iterator keys, uint64_t num_keys, sweep_parameters const& params,
+           build_configuration const& config) {
+    if (num_keys <= (uint64_t(1) << 30)) {
+        sweep<murmurhash2_64>(keys, num_keys, params, config);
+    } else {
+        sweep<murmurhash2_128>(keys, num_keys, params, config);
+    }
+}
+
+int main(int argc, char** argv) {
+    cmd_line_parser::parser parser(argc, argv);
+    parser.add("num_keys", "The size of the input.", "-n", true);
+    parser.add("c", "Comma-separated list of values of c (e.g., '3,5,7,9').", "-c", true);
+    parser.add("alpha", "Comma-separated list of load factors (e.g., '0.88,0.94,0.99,1.0').", "-a",
+               true);
+    parser.add("encoder_type",
+               "Comma-separated list of encoder types, or 'all'. Possible values are: " +
+                   encoder_names_list() + ". Default is 'all'.",
+               "-e", false);
+    parser.add("num_partitions", "Comma-separated list of numbers of partitions. Default is '1'.",
+               "-p", false);
+    parser.add("num_threads", "Number of threads to use for construction.", "-t", false);
+    parser.add("seed", "Seed to use for construction.", "-s", false);
+    parser.add("input_filename",
+               "A string input file name. If this is not provided, then num_keys 64-bit random "
+               "keys will be used as input instead.",
+               "-i", false);
+    parser.add("minimal_output", "Build minimal PHFs.", "--minimal", false, true);
+    parser.add("check", "Check correctness after each construction.", "--check", false, true);
+    parser.add("lookup", "Measure average lookup time after each construction.", "--lookup",
+               false, true);
+    if (!parser.parse()) return 1;
+
+    sweep_parameters params;
+    params.check = parser.get<bool>("check");
+    params.lookup = parser.get<bool>("lookup");
+    for (auto const& value : split(parser.get<std::string>("c"))) {
+        params.c.push_back(std::stod(value));
+    }
+    for (auto const& value : split(parser.get<std::string>("alpha"))) {
+        params.alpha.push_back(std::stod(value));
+    }
+    if (parser.parsed("num_partitions")) {
+        for (auto const& value : split(parser.get<std::string>("num_partitions"))) {
+            params.num_partitions.push_back(std::stoull(value));
+        }
+    } else {
+        params.num_partitions.push_back(1);
+    }
+    if (parser.parsed("encoder_type") and parser.get<std::string>("encoder_type") != "all") {
+        for (auto const& value : split(parser.get<std::string>("encoder_type"))) {
+            if (value == "all" or !for_each_encoder(value, [](auto) {})) {
+                std::cerr << "unknown encoder type '" << value << "'" << std::endl;
+                return 1;
+            }
+            params.encoder_types.push_back(value);
+        }
+    } else {
+        params.encoder_types = encoder_names();
+    }
+    if (params.c.empty() or params.alpha.empty() or params.num_partitions.empty() or
+        params.encoder_types.empty()) {
+        std::cerr << "empty list of parameters" << std::endl;
+        return 1;
+    }
+
+    build_configuration config;
+    config.minimal_output = parser.get<bool>("minimal_output");
+    config.verbose_output = false;
+    config.seed = parser.parsed("seed") ? parser.get<uint64_t>("seed") : random_value();
+    if (parser.parsed("num_threads")) {
+        config.num_threads = parser.get<uint64_t>("num_threads");
+        if (config.num_threads == 0) config.num_threads = 1;
+        uint64_t num_threads = std::thread::hardware_concurrency();
+        if (config.num_threads > num_threads) config.num_threads = num_threads;
+    }
+
+    auto num_keys = parser.get<uint64_t>("num_keys");
+    if (parser.parsed("input_filename")) {
+        auto input_filename = parser.get<std::string>("input_filename");
+        std::ifstream input(input_filename.c_str());
+        if (!input.good()) throw std::runtime_error("error in opening file.");
+        std::vector<std::string> keys = read_string_collection(num_keys, input, true);
+        input.close();
+        sweep(keys.begin(), keys.size(), params, config);
+    } else {
+        std::vector<uint64_t> keys = distinct_keys<uint64_t>(num_keys, config.seed);
+        sweep(keys.begin(), keys.size(), params, config);
+    }
+
+    return 0;
+}
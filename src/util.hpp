@@ -1,15 +1,22 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <cstring>
 #include <fstream>
+#include <glob.h>
 #include <iostream>
 #include <iomanip>
 #include <iterator>
 #include <sstream>  // for stringbuf
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "include/utils/util.hpp"
+#include "include/utils/hasher.hpp"
+#include "include/encoders/encoders.hpp"
+#include "external/mm_file/include/mm_file/mm_file.hpp"
 #include "essentials.hpp"
 
 namespace pthash {
@@ -96,6 +103,80 @@ private:
     std::string m_key;
 };
 
+/* The non-empty values of a comma-separated list. */
+static std::vector<std::string> split(std::string const& list) {
+    std::vector<std::string> values;
+    std::stringstream ss(list);
+    std::string value;
+    while (std::getline(ss, value, ',')) {
+        if (!value.empty()) values.push_back(value);
+    }
+    return values;
+}
+
+/*
+    The lines of several memory-mapped files, one file after the other, as byte_ranges
+    into the mappings (without the '\n'). As lines_iterator, it is a single-pass iterator:
+    each copy scans the files from where the original was when copied.
+*/
+struct files_lines_iterator : std::forward_iterator_tag {
+    typedef byte_range value_type;
+
+    files_lines_iterator(std::vector<mm::file_source<uint8_t>> const& files)
+        : m_files(&files), m_file(0), m_begin(nullptr), m_end(nullptr) {
+        if (!files.empty()) set(0);
+    }
+
+    byte_range operator*() {
+        while (m_begin == m_end and m_file + 1 < m_files->size()) set(m_file + 1);
+        if (m_begin == m_end) throw std::runtime_error("reached end of files");
+        auto newline = static_cast<uint8_t const*>(std::memchr(m_begin, '\n', m_end - m_begin));
+        byte_range line = {m_begin, newline ? newline : m_end};
+        m_begin = newline ? newline + 1 : m_end;
+        return line;
+    }
+
+    void operator++(int) const {}
+    void operator++() const {}
+    files_lines_iterator operator+(uint64_t) const {
+        throw std::runtime_error(
+            "files_lines_iterator::operator+(uint64_t) has not been implemented");
+    }
+
+private:
+    std::vector<mm::file_source<uint8_t>> const* m_files;
+    uint64_t m_file;
+    uint8_t const* m_begin;
+    uint8_t const* m_end;
+
+    void set(uint64_t file) {
+        m_file = file;
+        m_begin = (*m_files)[file].data();
+        m_end = m_begin + (*m_files)[file].size();
+    }
+};
+
+/*
+    The files of a comma-separated list of file names and glob patterns
+    (e.g., "keys.txt" or "shards/part-*.txt,extra.txt"), each pattern expanded in sorted order.
+*/
+static std::vector<std::string> input_files(std::string const& list) {
+    std::vector<std::string> filenames;
+    for (auto const& pattern : split(list)) {
+        if (pattern.find_first_of("*?[") == std::string::npos) {
+            filenames.push_back(pattern);
+            continue;
+        }
+        glob_t matches;
+        if (::glob(pattern.c_str(), 0, nullptr, &matches) != 0) {
+            throw std::runtime_error("no file matches '" + pattern + "'");
+        }
+        for (uint64_t i = 0; i != matches.gl_pathc; ++i) filenames.push_back(matches.gl_pathv[i]);
+        ::globfree(&matches);
+    }
+    return filenames;
+}
+
 template <typename IStream>
 std::vector<std::string> read_string_collection(uint64_t n, IStream& is, bool verbose) {
     progress_logger logger(n, "read ", " keys from file", verbose);
@@ -123,6 +204,362 @@ std::vector<std::string> read_string_collection(uint64_t n, IStream& is, bool ve
     return strings;
 }
 
+/*
+    The first n lines of one or more files (e.g., the shards of a key set), memory-mapped:
+    the keys are byte_ranges into the mappings (without the '\n'), so that no key is copied.
+    Only the offsets of the lines are stored, 8 bytes per key.
+    The newlines are found with memchr by num_threads threads: for a single file, in rounds
+    of block_size bytes per thread; for several files, one file per thread, in groups of
+    num_threads files, until n lines are found or the files end.
+    The collection must outlive the keys.
+*/
+struct mapped_string_collection {
+    static constexpr uint64_t block_size = uint64_t(1) << 26;
+
+    struct iterator {
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef byte_range value_type;
+        typedef int64_t difference_type;
+        typedef byte_range const* pointer;
+        typedef byte_range reference;
+
+        iterator(mapped_string_collection const* collection, uint64_t shard,
+                 uint64_t const* offsets)
+            : m_collection(collection), m_shard(shard), m_offsets(offsets) {
+            if (m_offsets) m_data = m_collection->m_shards[m_shard].data;
+        }
+
+        inline byte_range operator*() const {
+            return {m_data + m_offsets[0], m_data + m_offsets[1] - 1};
+        }
+        inline byte_range operator[](uint64_t i) const {
+            return *(*this + i);
+        }
+        inline iterator& operator++() {
+            ++m_offsets;
+            auto const& shards = m_collection->m_shards;
+            if (m_offsets == &shards[m_shard].offsets.back() and m_shard + 1 != shards.size()) {
+                *this = iterator(m_collection, m_shard + 1, shards[m_shard + 1].offsets.data());
+            }
+            return *this;
+        }
+        inline iterator operator+(uint64_t offset) const {
+            return m_collection->at(index() + offset);
+        }
+        inline difference_type operator-(iterator const& rhs) const {
+            return index() - rhs.index();
+        }
+        inline bool operator==(iterator const& rhs) const {
+            return m_offsets == rhs.m_offsets;
+        }
+        inline bool operator!=(iterator const& rhs) const {
+            return m_offsets != rhs.m_offsets;
+        }
+
+    private:
+        mapped_string_collection const* m_collection;
+        uint64_t m_shard;
+        uint64_t const* m_offsets;  // m_offsets[0] is the beginning of the current line
+        uint8_t const* m_data = nullptr;
+
+        uint64_t index() const {
+            if (!m_offsets) return 0;
+            auto const& shard = m_collection->m_shards[m_shard];
+            return shard.first_key + (m_offsets - shard.offsets.data());
+        }
+    };
+
+    // non construction-copyable: the iterators point to the collection
+    mapped_string_collection(mapped_string_collection const&) = delete;
+    // non copyable
+    mapped_string_collection& operator=(mapped_string_collection const&) = delete;
+
+    mapped_string_collection(std::string const& filename, uint64_t n, uint64_t num_threads,
+                             bool verbose)
+        : mapped_string_collection(std::vector<std::string>{filename}, n, num_threads, verbose) {}
+
+    mapped_string_collection(std::vector<std::string> const& filenames, uint64_t n,
+                             uint64_t num_threads, bool verbose)
+        : m_files(filenames.size()), m_size(0) {
+        if (num_threads == 0) num_threads = 1;
+        std::vector<shard> shards(filenames.size());
+        if (filenames.size() == 1) {
+            m_files[0].open(filenames[0], mm::advice::sequential);
+            scan(m_files[0], shards[0], n, num_threads);
+        } else {
+            uint64_t num_lines = 0;
+            for (uint64_t first = 0; first < filenames.size() and num_lines < n;
+                 first += num_threads) {
+                uint64_t last = std::min<uint64_t>(first + num_threads, filenames.size());
+                std::vector<std::thread> threads;
+                for (uint64_t i = first; i != last; ++i) {
+                    threads.emplace_back([&, i]() {
+                        m_files[i].open(filenames[i], mm::advice::sequential);
+                        scan(m_files[i], shards[i], n, 1);
+                    });
+                }
+                for (auto& t : threads) t.join();
+                for (uint64_t i = first; i != last; ++i) num_lines += shards[i].size();
+            }
+        }
+
+        /* keep the first n lines, dropping the empty shards */
+        for (uint64_t i = 0; i != shards.size(); ++i) {
+            auto& shard = shards[i];
+            if (m_size == n or shard.size() == 0) {
+                if (m_files[i].is_open()) m_files[i].close();
+                continue;
+            }
+            if (m_size + shard.size() > n) shard.offsets.resize(n - m_size + 1);
+            shard.offsets.shrink_to_fit();
+            shard.data = m_files[i].data();
+            shard.first_key = m_size;
+            m_size += shard.size();
+            m_shards.push_back(std::move(shard));
+        }
+
+        if (verbose) {
+            uint64_t max_string_length = 0, sum_of_lengths = 0;
+            for (auto const& shard : m_shards) {
+                for (uint64_t i = 0; i != shard.size(); ++i) {
+                    uint64_t length = shard.offsets[i + 1] - shard.offsets[i] - 1;
+                    max_string_length = std::max(max_string_length, length);
+                    sum_of_lengths += length;
+                }
+            }
+            std::cout << "num_files " << m_shards.size() << std::endl;
+            std::cout << "num_strings " << m_size << std::endl;
+            std::cout << "max_string_length " << max_string_length << std::endl;
+            std::cout << "total_length " << sum_of_lengths << std::endl;
+            std::cout << "avg_string_length " << std::fixed << std::setprecision(2)
+                      << static_cast<double>(sum_of_lengths) / m_size << std::endl;
+        }
+    }
+
+    uint64_t size() const {
+        return m_size;
+    }
+
+    iterator begin() const {
+        return at(0);
+    }
+
+    iterator end() const {
+        return at(m_size);
+    }
+
+    /*
+        Remove the keys of the given indices (sorted, e.g., the duplicates reported by
+        duplicate_keys_error): the shards are split around them, and no line is copied.
+    */
+    void drop(std::vector<uint64_t> const& indices) {
+        std::vector<shard> shards;
+        auto dropped = indices.begin();
+        uint64_t size = 0;
+        for (auto const& s : m_shards) {
+            uint64_t begin = 0;  // first kept line of the piece
+            while (begin != s.size()) {
+                uint64_t end = s.size();
+                if (dropped != indices.end() and *dropped < s.first_key + end) {
+                    end = *dropped - s.first_key;
+                }
+                if (end != begin) {
+                    shard piece;
+                    piece.data = s.data;
+                    piece.offsets.assign(s.offsets.begin() + begin, s.offsets.begin() + end + 1);
+                    piece.first_key = size;
+                    size += piece.size();
+                    shards.push_back(std::move(piece));
+                }
+                if (end == s.size()) break;
+                begin = end + 1;  // skip the dropped line
+                ++dropped;
+            }
+        }
+        m_shards.swap(shards);
+        m_size = size;
+    }
+
+private:
+    struct shard {
+        uint8_t const* data = nullptr;
+        /* offsets[i] is the beginning of the i-th line, i.e., one past the previous '\n' */
+        std::vector<uint64_t> offsets;
+        uint64_t first_key = 0;  // index of the first line in the collection
+
+        uint64_t size() const {
+            return offsets.empty() ? 0 : offsets.size() - 1;
+        }
+    };
+
+    std::vector<mm::file_source<uint8_t>> m_files;
+    std::vector<shard> m_shards;  // the non-empty ones
+    uint64_t m_size;
+
+    iterator at(uint64_t i) const {
+        if (m_shards.empty()) return iterator(this, 0, nullptr);
+        auto it = std::upper_bound(m_shards.begin(), m_shards.end(), i,
+                                   [](uint64_t key, shard const& s) { return key < s.first_key; });
+        uint64_t s = (it - m_shards.begin()) - 1;
+        return iterator(this, s, m_shards[s].offsets.data() + (i - m_shards[s].first_key));
+    }
+
+    /* the offsets of the first n lines of the file */
+    static void scan(mm::file_source<uint8_t> const& file, shard& shard, uint64_t n,
+                     uint64_t num_threads) {
+        uint8_t const* data = file.data();
+        uint64_t size = file.size();
+        auto& offsets = shard.offsets;
+        offsets.reserve(std::min(n, size) + 1);
+        offsets.push_back(0);
+        std::vector<std::vector<uint64_t>> newlines(num_threads);
+        for (uint64_t round_begin = 0; round_begin < size and offsets.size() <= n;
+             round_begin += num_threads * block_size) {
+            auto exe = [&](uint64_t i) {
+                newlines[i].clear();
+                uint64_t begin = std::min(round_begin + i * block_size, size);
+                uint64_t end = std::min(begin + block_size, size);
+                uint8_t const* p = data + begin;
+                while (p != data + end) {
+                    auto q = static_cast<uint8_t const*>(std::memchr(p, '\n', data + end - p));
+                    if (q == nullptr) break;
+                    newlines[i].push_back(q - data + 1);
+                    p = q + 1;
+                }
+            };
+            if (num_threads == 1) {
+                exe(0);
+            } else {
+                std::vector<std::thread> threads;
+                threads.reserve(num_threads);
+                for (uint64_t i = 0; i != num_threads; ++i) threads.emplace_back(exe, i);
+                for (auto& t : threads) t.join();
+            }
+            for (auto const& lines : newlines) {
+                uint64_t k = std::min<uint64_t>(lines.size(), n + 1 - offsets.size());
+                offsets.insert(offsets.end(), lines.begin(), lines.begin() + k);
+            }
+        }
+        /* last line without '\n' */
+        if (offsets.size() <= n and offsets.back() < size) offsets.push_back(size + 1);
+    }
+};
+
+/* Remove the keys of the given indices (sorted) from keys. */
+template <typename T>
+void drop(std::vector<T>& keys, std::vector<uint64_t> const& indices) {
+    auto dropped = indices.begin();
+    uint64_t size = 0;
+    for (uint64_t i = 0; i != keys.size(); ++i) {
+        if (dropped != indices.end() and *dropped == i) {
+            ++dropped;
+            continue;
+        }
+        if (size != i) keys[size] = std::move(keys[i]);
+        ++size;
+    }
+    keys.resize(size);
+}
+
+static void drop(mapped_string_collection& keys, std::vector<uint64_t> const& indices) {
+    keys.drop(indices);
+}
+
+/*
+    Keys of a binary file of fixed-width records (e.g., a column of 32-, 64- or 128-bit
+    integers), as byte_ranges of key_bytes bytes each into the memory-mapped file.
+    For 8-byte keys, the hash of a key equals that of the corresponding uint64_t.
+*/
+struct fixed_width_iterator {
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef byte_range value_type;
+    typedef int64_t difference_type;
+    typedef byte_range const* pointer;
+    typedef byte_range reference;
+
+    fixed_width_iterator(uint8_t const* data, uint64_t key_bytes)
+        : m_data(data), m_key_bytes(key_bytes) {}
+
+    inline byte_range operator*() const {
+        return {m_data, m_data + m_key_bytes};
+    }
+    inline byte_range operator[](uint64_t i) const {
+        return *(*this + i);
+    }
+    inline fixed_width_iterator& operator++() {
+        m_data += m_key_bytes;
+        return *this;
+    }
+    inline fixed_width_iterator operator+(uint64_t offset) const {
+        return fixed_width_iterator(m_data + offset * m_key_bytes, m_key_bytes);
+    }
+    inline difference_type operator-(fixed_width_iterator const& rhs) const {
+        return (m_data - rhs.m_data) / static_cast<difference_type>(m_key_bytes);
+    }
+    inline bool operator==(fixed_width_iterator const& rhs) const {
+        return m_data == rhs.m_data;
+    }
+    inline bool operator!=(fixed_width_iterator const& rhs) const {
+        return m_data != rhs.m_data;
+    }
+
+private:
+    uint8_t const* m_data;
+    uint64_t m_key_bytes;
+};
+
+/*
+    Inputs of precomputed hashes: a binary file of hash64 (8 bytes each) or hash128
+    (16 bytes each, first() then second()) is read in place through a hash64 const* or
+    hash128 const* into the memory-mapping, and fed to build_from_hashes.
+    A function built from hashes is evaluated with position(hash): hash_evaluator
+    exposes it as operator(), so that check and perf can be used.
+*/
+template <typename T>
+struct is_hash : std::false_type {};
+template <>
+struct is_hash<hash64> : std::true_type {};
+template <>
+struct is_hash<hash128> : std::true_type {};
+
+static_assert(sizeof(hash64) == 8 and sizeof(hash128) == 16);
+
+template <typename Function>
+struct hash_evaluator {
+    static constexpr bool minimal = Function::minimal;
+
+    hash_evaluator(Function const& f) : m_f(f) {}
+
+    inline uint64_t operator()(typename Function::hasher_type::hash_type const& hash) const {
+        return m_f.position(hash);
+    }
+
+    uint64_t num_keys() const {
+        return m_f.num_keys();
+    }
+
+    uint64_t table_size() const {
+        return m_f.table_size();
+    }
+
+private:
+    Function const& m_f;
+};
+
+/* The keys of Iterator, without reference and const. */
+template <typename Iterator>
+using key_type_t = std::decay_t<decltype(*std::declval<Iterator&>())>;
+
+/* f itself for keys, and hash_evaluator<Function>(f) for hashes. */
+template <typename Iterator, typename Function>
+decltype(auto) evaluator(Function const& f) {
+    if constexpr (is_hash<key_type_t<Iterator>>::value) {
+        return hash_evaluator<Function>(f);
+    } else {
+        return f;
+    }
+}
+
 template <typename Uint>
 std::vector<Uint> distinct_keys(uint64_t num_keys, uint64_t seed = constants::invalid_seed) {
     assert(num_keys > 0);
@@ -191,12 +628,236 @@ bool check(Iterator keys, Function const& f) {
     return true;
 }
 
+template <typename Key>
+void print_key(Key const& key) {
+    if constexpr (std::is_same_v<Key, std::string>) {
+        std::cout << " '" << key << "'";
+    } else if constexpr (std::is_same_v<Key, byte_range>) {
+        auto begin = reinterpret_cast<char const*>(key.begin);
+        std::cout << " '" << std::string(begin, key.end - key.begin) << "'";
+    } else if constexpr (std::is_integral_v<Key>) {
+        std::cout << " " << key;
+    }
+}
+
+/*
+    Scan the keys again, sequentially, and report the first key (in input order) whose position
+    is out of range or was already taken by a previous key, together with that previous key.
+*/
+template <typename Function, typename Iterator>
+void report_first_error(Iterator keys, Function const& f, uint64_t range) {
+    uint64_t n = f.num_keys();
+    bit_vector_builder taken(range);
+    Iterator it = keys;
+    for (uint64_t i = 0; i != n; ++i) {
+        key_type_t<Iterator> key = *it;
+        uint64_t p = f(key);
+        if (p >= range) {
+            std::cout << "ERROR: key " << i;
+            print_key(key);
+            std::cout << " is mapped to position " << p << ", which is out of range [0," << range
+                      << ")" << std::endl;
+            return;
+        }
+        if (taken.get(p) != 0) {
+            Iterator other = keys;
+            for (uint64_t j = 0; j != i; ++j) {
+                key_type_t<Iterator> other_key = *other;
+                if (f(other_key) == p) {
+                    std::cout << "ERROR: keys " << j;
+                    print_key(other_key);
+                    std::cout << " and " << i;
+                    print_key(key);
+                    std::cout << " are both mapped to position " << p << std::endl;
+                    return;
+                }
+                ++other;
+            }
+        }
+        taken.set(p, 1);
+        ++it;
+    }
+}
+
+/*
+    Print the first duplicates of duplicate_keys_error, with the keys, which are read in a single
+    pass (so that also single-pass iterators, such as lines_iterator, can be used).
+*/
+template <typename Iterator>
+void print_duplicate_keys(Iterator keys,
+                          std::vector<std::pair<uint64_t, uint64_t>> const& duplicates) {
+    constexpr uint64_t max_printed = 10;
+    uint64_t num_printed = std::min<uint64_t>(duplicates.size(), max_printed);
+    if (num_printed == 0) return;
+    uint64_t last = duplicates[num_printed - 1].first;
+    std::vector<key_type_t<Iterator>> first_keys(num_printed);
+    Iterator it = keys;
+    for (uint64_t i = 0, k = 0; i <= last; ++i, ++it) {
+        key_type_t<Iterator> key = *it;
+        for (uint64_t d = 0; d != num_printed; ++d) {
+            if (duplicates[d].second == i) first_keys[d] = key;
+        }
+        if (i == duplicates[k].first) {
+            std::cout << "ERROR: key " << i;
+            print_key(key);
+            std::cout << " is equal to key " << duplicates[k].second;
+            print_key(first_keys[k]);
+            std::cout << std::endl;
+            ++k;
+        }
+    }
+    if (duplicates.size() > num_printed) {
+        std::cout << "... and " << duplicates.size() - num_printed << " more duplicate keys"
+                  << std::endl;
+    }
+}
+
+/*
+    Multi-threaded check. The keys are split among num_threads threads (by index for
+    random-access iterators, or in rounds of keys read sequentially for single-pass iterators
+    such as lines_iterator) and every thread marks the positions of its keys in a shared bitmap
+    with an atomic fetch_or, so that a position taken twice is detected exactly, also for minimal
+    functions (for which the sequential check only compares the sum of the positions).
+    On failure, the first conflicting keys (in input order) are reported by report_first_error,
+    which reads the keys again: for single-pass iterators (see is_multi_pass_iterator), the
+    conflict detected by the threads is reported instead, without the other key.
+*/
+template <typename Function, typename Iterator>
+bool check(Iterator keys, Function const& f, uint64_t num_threads) {
+    if (num_threads == 0) num_threads = 1;
+    uint64_t n = f.num_keys();
+    uint64_t range = Function::minimal ? n : f.table_size();
+    std::vector<std::atomic<uint64_t>> taken((range + 63) / 64);
+    std::atomic<bool> failed(false);
+    struct {
+        uint64_t index;
+        uint64_t position;
+        key_type_t<Iterator> key;
+    } error{};  // the first conflict detected, written by the thread that sets failed
+
+    /* mark the positions of the keys [begin, begin + count), the first being the index-th */
+    auto mark = [&](auto begin, uint64_t count, uint64_t index) {
+        for (uint64_t i = 0; i != count; ++i, ++begin) {
+            if ((i & 4095) == 0 and failed.load(std::memory_order_relaxed)) return;
+            auto const& key = *begin;
+            uint64_t p = f(key);
+            uint64_t bit = uint64_t(1) << (p & 63);
+            if (p >= range or (taken[p >> 6].fetch_or(bit, std::memory_order_relaxed) & bit)) {
+                if (!failed.exchange(true)) error = {index + i, p, key};
+                return;
+            }
+        }
+    };
+    auto run = [&](auto begin, uint64_t count, uint64_t index) {
+        if (num_threads == 1) {
+            mark(begin, count, index);
+            return;
+        }
+        uint64_t keys_per_thread = (count + num_threads - 1) / num_threads;
+        std::vector<std::thread> threads;
+        threads.reserve(num_threads);
+        for (uint64_t t = 0; t != num_threads; ++t) {
+            uint64_t first = std::min(t * keys_per_thread, count);
+            uint64_t last = std::min(first + keys_per_thread, count);
+            threads.emplace_back(mark, begin + first, last - first, index + first);
+        }
+        for (auto& t : threads) t.join();
+    };
+
+    if constexpr (!is_random_access_iterator<Iterator>::value) {
+        const uint64_t round_size = num_threads * (uint64_t(1) << 16);
+        std::vector<key_type_t<Iterator>> round;
+        round.reserve(std::min(round_size, n));
+        Iterator it = keys;
+        for (uint64_t i = 0; i != n and !failed; i += round.size()) {
+            round.clear();
+            uint64_t size = std::min(round_size, n - i);
+            for (uint64_t j = 0; j != size; ++j, ++it) round.push_back(*it);
+            run(round.begin(), size, i);
+        }
+    } else {
+        run(keys, n, 0);
+    }
+
+    if (failed) {
+        if constexpr (is_multi_pass_iterator<Iterator>::value) {
+            report_first_error(keys, f, range);
+        } else {
+            std::cout << "ERROR: key " << error.index;
+            print_key(error.key);
+            std::cout << " is mapped to position " << error.position;
+            if (error.position >= range) {
+                std::cout << ", which is out of range [0," << range << ")" << std::endl;
+            } else {
+                std::cout << ", which is taken by another key" << std::endl;
+            }
+        }
+        return false;
+    }
+    return true;
+}
+
+/* The argument of the function called by for_each_encoder: name is the name of Encoder. */
+template <typename Encoder>
+struct encoder_tag {
+    typedef Encoder type;
+    char const* name;
+};
+
+/*
+    Call fn(encoder_tag<Encoder>{...}) for the encoder type called name, or for all encoder types
+    (in the order listed below) if name is "all". Return false if name is not an encoder type.
+    This is the only place where the encoder types accepted by the tools are listed.
+*/
+template <typename Function>
+bool for_each_encoder(std::string const& name, Function fn) {
+    bool found = false;
+    auto visit = [&](auto tag) {
+        if (name == "all" or name == tag.name) {
+            fn(tag);
+            found = true;
+        }
+    };
+#ifdef PTHASH_ENABLE_ALL_ENCODERS
+    visit(encoder_tag<compact>{"compact"});
+#endif
+    visit(encoder_tag<partitioned_compact>{"partitioned_compact"});
+#ifdef PTHASH_ENABLE_ALL_ENCODERS
+    visit(encoder_tag<compact_compact>{"compact_compact"});
+    visit(encoder_tag<dictionary>{"dictionary"});
+#endif
+    visit(encoder_tag<dictionary_dictionary>{"dictionary_dictionary"});
+    visit(encoder_tag<elias_fano>{"elias_fano"});
+#ifdef PTHASH_ENABLE_ALL_ENCODERS
+    visit(encoder_tag<dictionary_elias_fano>{"dictionary_elias_fano"});
+    visit(encoder_tag<sdc>{"sdc"});
+#endif
+    return found;
+}
+
+static std::vector<std::string> encoder_names() {
+    std::vector<std::string> names;
+    for_each_encoder("all", [&](auto tag) { names.push_back(tag.name); });
+    return names;
+}
+
+/* The encoder types as a list for the help of the tools, e.g. "'elias_fano', 'sdc'". */
+static std::string encoder_names_list() {
+    std::string list;
+    for (auto const& name : encoder_names()) list += (list.empty() ? "'" : ", '") + name + "'";
+#ifndef PTHASH_ENABLE_ALL_ENCODERS
+    list += " (for more encoders, compile again with 'cmake .. -D PTHASH_ENABLE_ALL_ENCODERS=On')";
+#endif
+    return list;
+}
+
+static const uint64_t perf_runs = 5;
+
 template <typename Function, typename Iterator>
 double perf(Iterator keys, uint64_t num_keys, Function const& f) {
-    static const uint64_t runs = 5;
     essentials::timer<std::chrono::high_resolution_clock, std::chrono::nanoseconds> t;
     t.start();
-    for (uint64_t r = 0; r != runs; ++r) {
+    for (uint64_t r = 0; r != perf_runs; ++r) {
         Iterator begin = keys;
         for (uint64_t i = 0; i != num_keys; ++i) {
             auto const& key = *begin;
@@ -206,7 +867,7 @@ double perf(Iterator keys, uint64_t num_keys, Function const& f) {
         }
     }
     t.stop();
-    double nanosec_per_key = t.elapsed() / static_cast<double>(runs * num_keys);
+    double nanosec_per_key = t.elapsed() / static_cast<double>(perf_runs * num_keys);
     return nanosec_per_key;
 }
 
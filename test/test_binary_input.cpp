@@ -0,0 +1,112 @@
+#include <cstdio>  // for std::remove
+
+#include "common.hpp"
+
+using namespace pthash;
+
+template <typename T>
+static void write_binary(std::string const& filename, std::vector<T> const& data) {
+    std::ofstream out(filename.c_str(), std::ofstream::binary);
+    out.write(reinterpret_cast<char const*>(data.data()), data.size() * sizeof(T));
+}
+
+/* A file of num_keys distinct keys of key_bytes bytes each, read as in build -b key_bytes. */
+void test_fixed_width_keys(std::string const& filename, uint64_t key_bytes, uint64_t num_keys) {
+    std::cout << "testing " << num_keys << " keys of " << key_bytes << " bytes..." << std::endl;
+    std::vector<uint8_t> data(num_keys * key_bytes);
+    for (uint64_t i = 0; i != num_keys; ++i) {
+        /* odd multipliers are bijective on the low 32 bits, hence the keys are distinct */
+        uint64_t x = i * 0x9e3779b97f4a7c15ULL;
+        uint64_t y = ~x;
+        std::memcpy(data.data() + i * key_bytes, &x, std::min<uint64_t>(key_bytes, 8));
+        if (key_bytes > 8) std::memcpy(data.data() + i * key_bytes + 8, &y, key_bytes - 8);
+    }
+    write_binary(filename, data);
+
+    mm::file_source<uint8_t> input(filename, mm::advice::normal);
+    testing::require_equal(uint64_t(input.size()), num_keys * key_bytes);
+    fixed_width_iterator keys(input.data(), key_bytes);
+    testing::require_equal(uint64_t((keys + num_keys) - keys), num_keys);
+    for (uint64_t i = 0; i != num_keys; ++i) {
+        byte_range key = keys[i];
+        testing::require_equal(uint64_t(key.end - key.begin), key_bytes);
+        testing::require_equal(std::memcmp(key.begin, data.data() + i * key_bytes, key_bytes), 0);
+    }
+
+    build_configuration config;
+    config.minimal_output = true;  // mphf
+    config.verbose_output = false;
+    config.seed = random_value();
+    std::vector<uint64_t> positions(num_keys);
+
+    single_phf<murmurhash2_64, dictionary_dictionary, true> f;
+    f.build_in_internal_memory(keys, num_keys, config, positions.begin());
+    testing::require_equal(check(keys, f), true);
+    for (uint64_t i = 0; i != num_keys; ++i) testing::require_equal(f(keys[i]), positions[i]);
+
+    config.num_partitions = 4;
+    partitioned_phf<murmurhash2_128, dictionary_dictionary, true> g;
+    g.build_in_external_memory(keys, num_keys, config, positions.begin());
+    testing::require_equal(check(keys, g), true);
+    for (uint64_t i = 0; i != num_keys; ++i) testing::require_equal(g(keys[i]), positions[i]);
+
+    /* 8-byte keys hash as the corresponding uint64_t */
+    if (key_bytes == 8) {
+        for (uint64_t i = 0; i != num_keys; ++i) {
+            uint64_t x;
+            std::memcpy(&x, data.data() + i * 8, 8);
+            testing::require_equal(f(x), f(keys[i]));
+        }
+    }
+
+    input.close();
+    std::remove(filename.c_str());
+}
+
+/* A file of the hashes of the keys, read as in build -H 64 or -H 128. */
+template <typename Hasher>
+void test_hashes(std::string const& filename, std::vector<uint64_t> const& keys) {
+    typedef typename Hasher::hash_type hash_type;
+    typedef single_phf<Hasher, dictionary_dictionary, true> function_type;
+    uint64_t num_keys = keys.size();
+    std::cout << "testing " << num_keys << " hashes of " << sizeof(hash_type) * 8 << " bits..."
+              << std::endl;
+
+    build_configuration config;
+    config.minimal_output = true;  // mphf
+    config.verbose_output = false;
+    config.seed = random_value();
+    std::vector<hash_type> data;
+    data.reserve(num_keys);
+    for (auto key : keys) data.push_back(Hasher::hash(key, config.seed));
+    write_binary(filename, data);
+
+    mm::file_source<uint8_t> input(filename, mm::advice::normal);
+    testing::require_equal(uint64_t(input.size()), num_keys * sizeof(hash_type));
+    hash_type const* hashes = reinterpret_cast<hash_type const*>(input.data());
+
+    internal_memory_builder_single_phf<Hasher> builder;
+    builder.build_from_hashes(hashes, num_keys, config);
+    function_type f;
+    f.build(builder, config);
+    hash_evaluator<function_type> evaluator(f);
+    testing::require_equal(check(hashes, evaluator), true);
+    testing::require_equal(check(keys.begin(), f), true);
+    for (uint64_t i = 0; i != num_keys; ++i) {
+        testing::require_equal(evaluator(hashes[i]), f(keys[i]));
+    }
+
+    input.close();
+    std::remove(filename.c_str());
+}
+
+int main() {
+    static_assert(sizeof(hash64) == 8 and sizeof(hash128) == 16);
+    std::string filename = constants::default_tmp_dirname + "/pthash.temp.test_binary.bin";
+    for (uint64_t key_bytes : {4, 8, 13, 16}) test_fixed_width_keys(filename, key_bytes, 100000);
+
+    std::vector<uint64_t> keys = distinct_keys<uint64_t>(100000, random_value());
+    test_hashes<murmurhash2_64>(filename, keys);
+    test_hashes<murmurhash2_128>(filename, keys);
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <cstdio>  // for std::remove
+
+#include "common.hpp"
+
+using namespace pthash;
+
+/*
+    The external-memory builders fed with the hashes of the keys, memory-mapped from a file,
+    build the same functions as from the keys, with the same seed.
+*/
+template <typename Function, typename Builder>
+void test_build_from_hashes(std::vector<uint64_t> const& keys, build_configuration const& config) {
+    typedef typename Builder::hasher_type hasher_type;
+    typedef typename hasher_type::hash_type hash_type;
+    uint64_t num_keys = keys.size();
+
+    std::string filename = config.tmp_dir + "/pthash.temp.hashes.bin";
+    {
+        std::vector<hash_type> hashes;
+        hashes.reserve(num_keys);
+        for (auto key : keys) hashes.push_back(hasher_type::hash(key, config.seed));
+        std::ofstream out(filename.c_str(), std::ofstream::binary);
+        out.write(reinterpret_cast<char const*>(hashes.data()), num_keys * sizeof(hash_type));
+    }
+    mm::file_source<hash_type> hashes(filename, mm::advice::sequential);
+    testing::require_equal(uint64_t(hashes.size()), num_keys);
+
+    std::vector<uint64_t> positions(num_keys);
+    Builder builder;
+    builder.build_from_hashes(hashes.data(), num_keys, config, positions.begin());
+    Function f;
+    f.build(builder, config);
+    testing::require_equal(f.seed(), config.seed);
+    testing::require_equal(check(keys.begin(), f), true);
+    for (uint64_t i = 0; i != num_keys; ++i) {
+        testing::require_equal(f.position(hashes.data()[i]), positions[i]);
+        testing::require_equal(f(keys[i]), positions[i]);
+    }
+    hashes.close();
+    std::remove(filename.c_str());
+
+    Function g;
+    g.build_in_external_memory(keys.begin(), num_keys, config);
+    for (auto key : keys) testing::require_equal(g(key), f(key));
+}
+
+template <typename Hasher>
+void test_external_memory_build_from_hashes(std::vector<uint64_t> const& keys) {
+    std::cout << "testing on " << keys.size() << " keys with "
+              << sizeof(typename Hasher::hash_type) * 8 << "-bit hashes..." << std::endl;
+
+    build_configuration config;
+    config.minimal_output = true;  // mphf
+    config.verbose_output = false;
+    config.seed = random_value();
+
+    test_build_from_hashes<single_phf<Hasher, dictionary_dictionary, true>,
+                           external_memory_builder_single_phf<Hasher>>(keys, config);
+    config.num_partitions = 8;
+    test_build_from_hashes<partitioned_phf<Hasher, dictionary_dictionary, true>,
+                           external_memory_builder_partitioned_phf<Hasher>>(keys, config);
+}
+
+/* Hashes that fail with a seed_runtime_error at the k-th one. */
+template <typename Hash>
+struct failing_hashes {
+    Hash operator*() {
+        if (num_read++ == k) throw seed_runtime_error();
+        return *hashes;
+    }
+    void operator++() {
+        ++hashes;
+    }
+    Hash const* hashes;
+    uint64_t k;
+    uint64_t num_read = 0;
+};
+
+/* An exception of the input reaches the caller with its type (it is not sliced). */
+void test_input_exception(std::vector<uint64_t> const& keys) {
+    std::vector<hash64> hashes;
+    for (auto key : keys) hashes.push_back(murmurhash2_64::hash(key, 0));
+    build_configuration config;
+    config.minimal_output = true;  // mphf
+    config.verbose_output = false;
+    config.seed = 0;
+    bool thrown = false;
+    try {
+        external_memory_builder_single_phf<murmurhash2_64> builder;
+        builder.build_from_hashes(failing_hashes<hash64>{hashes.data(), keys.size() / 2},
+                                  keys.size(), config);
+    } catch (seed_runtime_error const&) {
+        thrown = true;
+    }
+    testing::require_equal(thrown, true);
+}
+
+int main() {
+    std::vector<uint64_t> keys = distinct_keys<uint64_t>(200000, random_value());
+    test_external_memory_build_from_hashes<murmurhash2_64>(keys);
+    test_external_memory_build_from_hashes<murmurhash2_128>(keys);
+    test_input_exception(keys);
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include "common.hpp"
+
+using namespace pthash;
+
+/* Records the bytes that the partitioning writes and that the partition builders read back. */
+struct io_recorder : telemetry_sink {
+    void io(build_phase phase, uint64_t bytes_read, uint64_t bytes_written) override {
+        if (phase == build_phase::partitioning) partitions_bytes_written += bytes_written;
+        if (phase == build_phase::mapping_ordering) partitions_bytes_read += bytes_read;
+    }
+    uint64_t partitions_bytes_written = 0;
+    uint64_t partitions_bytes_read = 0;
+};
+
+template <typename Function>
+void test_positions(Function const& f, std::vector<uint64_t> const& keys,
+                    std::vector<uint64_t> const& positions) {
+    testing::require_equal(f.num_keys(), uint64_t(keys.size()));
+    testing::require_equal(check(keys.begin(), f), true);
+    for (uint64_t i = 0; i != keys.size(); ++i) testing::require_equal(f(keys[i]), positions[i]);
+}
+
+template <typename Hasher>
+void test_external_memory_partitioned_mphf(std::vector<uint64_t> const& keys) {
+    typedef typename partition_entries<Hasher>::entry_type entry_type;
+    uint64_t num_keys = keys.size();
+
+    build_configuration config;
+    config.minimal_output = true;  // mphf
+    config.verbose_output = false;
+    config.seed = random_value();
+
+    std::vector<uint64_t> positions(num_keys);
+    for (uint64_t num_partitions : {1, 8}) {
+        config.num_partitions = num_partitions;
+        for (uint64_t num_threads : {1, 3}) {
+            config.num_threads = num_threads;
+            /* with less RAM than the entries, the partitions are spilled several times */
+            uint64_t entries_bytes = num_keys * (sizeof(entry_type) + sizeof(uint64_t));
+            for (uint64_t ram : {constants::available_ram, entries_bytes / 4}) {
+                config.ram = ram;
+                std::cout << "testing with (hash_type=" << sizeof(typename Hasher::hash_type)
+                          << " bytes;num_partitions=" << num_partitions
+                          << ";num_threads=" << num_threads << ";ram=" << ram << ")..."
+                          << std::endl;
+
+                io_recorder recorder;
+                config.telemetry = &recorder;
+                std::fill(positions.begin(), positions.end(), 0);
+                external_memory_builder_partitioned_phf<Hasher> builder;
+                builder.build_from_keys(keys.begin(), num_keys, config, positions.begin());
+                testing::require_equal(recorder.partitions_bytes_written, entries_bytes);
+                testing::require_equal(recorder.partitions_bytes_read, entries_bytes);
+
+                config.telemetry = &noop_telemetry;
+                partitioned_phf<Hasher, dictionary_dictionary, true> f;
+                f.build(builder, config);
+                test_positions(f, keys, positions);
+            }
+        }
+    }
+}
+
+int main() {
+    /* 128-bit hashes are stored as 12-byte (bucket id, payload) pairs, 64-bit hashes as such */
+    static_assert(partition_entries<murmurhash2_128>::compact);
+    static_assert(sizeof(partition_entries<murmurhash2_128>::entry_type) == 12);
+    static_assert(!partition_entries<murmurhash2_64>::compact);
+
+    std::vector<uint64_t> keys = distinct_keys<uint64_t>(300000, random_value());
+    test_external_memory_partitioned_mphf<murmurhash2_64>(keys);
+    test_external_memory_partitioned_mphf<murmurhash2_128>(keys);
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include <cstdio>  // for std::remove
+
+#include "common.hpp"
+
+using namespace pthash;
+
+static std::string to_string(byte_range key) {
+    return std::string(reinterpret_cast<char const*>(key.begin), key.end - key.begin);
+}
+
+/* Write the lines to the file, the last one without '\n' unless trailing_newline. */
+static void write_lines(std::string const& filename, std::vector<std::string> const& lines,
+                        bool trailing_newline) {
+    std::ofstream out(filename.c_str(), std::ofstream::binary);
+    for (uint64_t i = 0; i != lines.size(); ++i) {
+        out << lines[i];
+        if (i + 1 != lines.size() or trailing_newline) out << '\n';
+    }
+}
+
+void test_input_files(std::string const& prefix, std::vector<std::string> const& shards) {
+    /* a pattern is expanded in sorted order, a plain name is kept as it is */
+    auto filenames = input_files(prefix + "shard.*");
+    testing::require_equal(filenames == shards, true);
+    filenames = input_files(prefix + "shard.3," + prefix + "shard.[01],," + prefix + "none");
+    std::vector<std::string> expected = {shards[3], shards[0], shards[1], prefix + "none"};
+    testing::require_equal(filenames == expected, true);
+
+    bool thrown = false;
+    try {
+        input_files(prefix + "none.*");
+    } catch (std::runtime_error const&) {
+        thrown = true;
+    }
+    testing::require_equal(thrown, true);
+}
+
+template <typename Function>
+void test_positions(Function const& f, std::vector<std::string> const& lines,
+                    std::vector<uint64_t> const& positions) {
+    testing::require_equal(check(lines.begin(), f), true);
+    for (uint64_t i = 0; i != lines.size(); ++i) testing::require_equal(f(lines[i]), positions[i]);
+}
+
+int main() {
+    std::string prefix = constants::default_tmp_dirname + "/pthash.temp.test_files.";
+    std::vector<uint64_t> values = distinct_keys<uint64_t>(20000, random_value());
+    std::vector<std::string> lines;
+    for (auto value : values) lines.push_back(std::to_string(value));
+
+    /*
+        Four shards, the third one empty: the first one ends with a newline,
+        the others do not, so their last line must not be merged with the next.
+    */
+    std::vector<std::string> shards;
+    for (uint64_t i = 0, begin = 0; i != 4; ++i) {
+        uint64_t end = i == 2 ? begin : std::min<uint64_t>(begin + 7000, lines.size());
+        shards.push_back(prefix + "shard." + std::to_string(i));
+        write_lines(shards.back(),
+                    std::vector<std::string>(lines.begin() + begin, lines.begin() + end), i == 0);
+        begin = end;
+    }
+
+    std::cout << "testing input_files..." << std::endl;
+    test_input_files(prefix, shards);
+
+    std::cout << "testing files_lines_iterator..." << std::endl;
+    std::vector<mm::file_source<uint8_t>> inputs(shards.size());
+    for (uint64_t i = 0; i != shards.size(); ++i) {
+        inputs[i].open(shards[i], mm::advice::sequential);
+    }
+    {
+        files_lines_iterator keys(inputs);
+        for (auto const& line : lines) testing::require_equal(to_string(*keys), line);
+        bool thrown = false;
+        try {
+            *keys;
+        } catch (std::runtime_error const&) {
+            thrown = true;
+        }
+        testing::require_equal(thrown, true);
+    }
+
+    std::cout << "testing an external-memory build..." << std::endl;
+    {
+        build_configuration config;
+        config.minimal_output = true;  // mphf
+        config.verbose_output = false;
+        std::vector<uint64_t> positions(lines.size());
+        single_phf<murmurhash2_64, dictionary_dictionary, true> f;
+        f.build_in_external_memory(files_lines_iterator(inputs), lines.size(), config,
+                                   positions.begin());
+        test_positions(f, lines, positions);
+
+        config.num_partitions = 2;
+        partitioned_phf<murmurhash2_64, dictionary_dictionary, true> g;
+        g.build_in_external_memory(files_lines_iterator(inputs), lines.size(), config,
+                                   positions.begin());
+        test_positions(g, lines, positions);
+    }
+
+    for (auto& input : inputs) input.close();
+    for (auto const& shard : shards) std::remove(shard.c_str());
+    return 0;
+}
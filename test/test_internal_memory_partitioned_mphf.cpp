@@ -8,7 +8,23 @@ void test_encoder(Builder& builder, build_configuration const& config, Iterator
     partitioned_phf<typename Builder::hasher_type, Encoder, true> f;
     f.build(builder, config);
     testing::require_equal(f.num_keys(), num_keys);
-    check(keys, f);
+    testing::require_equal(check(keys, f), true);
+    testing::require_equal(check(keys, f, 4), true);
+}
+
+template <typename Builder, typename Iterator>
+void test_positions(Builder const& builder, build_configuration const& config, Iterator keys,
+                    uint64_t num_keys, std::vector<uint64_t> const& positions) {
+    partitioned_phf<typename Builder::hasher_type, dictionary_dictionary, true> f;
+    f.build(builder, config);
+    for (uint64_t i = 0; i != num_keys; ++i) testing::require_equal(positions[i], f(keys[i]));
+    std::vector<uint64_t> bulk_positions(num_keys);
+    f.evaluate(keys, num_keys, bulk_positions.begin(), 2);
+    testing::require_equal(bulk_positions == positions, true);
+    std::fill(bulk_positions.begin(), bulk_positions.end(), 0);
+    partition_affine_lookup engine(f, 4);
+    engine.lookup(keys, num_keys, bulk_positions.begin());
+    testing::require_equal(bulk_positions == positions, true);
 }
 
 template <typename Iterator>
@@ -24,6 +40,7 @@ void test_internal_memory_partitioned_mphf(Iterator keys, uint64_t num_keys) {
     config.seed = random_value();
 
     std::vector<uint64_t> num_partitions{1, 16, 32, 64};
+    std::vector<uint64_t> positions(num_keys);
     std::vector<double> C{4.0, 4.5, 5.0, 5.5, 6.0};
     std::vector<double> A{1.0, 0.99, 0.98, 0.97, 0.96};
     for (auto c : C) {
@@ -37,7 +54,7 @@ void test_internal_memory_partitioned_mphf(Iterator keys, uint64_t num_keys) {
                 std::cout << "testing with (c=" << c << ";alpha=" << alpha
                           << ";num_partitions=" << p << ")..." << std::endl;
 
-                builder_64.build_from_keys(keys, num_keys, config);
+                builder_64.build_from_keys(keys, num_keys, config, positions.begin());
                 test_encoder<compact>(builder_64, config, keys, num_keys);
                 test_encoder<partitioned_compact>(builder_64, config, keys, num_keys);
                 test_encoder<compact_compact>(builder_64, config, keys, num_keys);
@@ -46,8 +63,9 @@ void test_internal_memory_partitioned_mphf(Iterator keys, uint64_t num_keys) {
                 test_encoder<elias_fano>(builder_64, config, keys, num_keys);
                 test_encoder<dictionary_elias_fano>(builder_64, config, keys, num_keys);
                 test_encoder<sdc>(builder_64, config, keys, num_keys);
+                test_positions(builder_64, config, keys, num_keys, positions);
 
-                builder_128.build_from_keys(keys, num_keys, config);
+                builder_128.build_from_keys(keys, num_keys, config, positions.begin());
                 test_encoder<compact>(builder_128, config, keys, num_keys);
                 test_encoder<partitioned_compact>(builder_128, config, keys, num_keys);
                 test_encoder<compact_compact>(builder_128, config, keys, num_keys);
@@ -56,6 +74,7 @@ void test_internal_memory_partitioned_mphf(Iterator keys, uint64_t num_keys) {
                 test_encoder<elias_fano>(builder_128, config, keys, num_keys);
                 test_encoder<dictionary_elias_fano>(builder_128, config, keys, num_keys);
                 test_encoder<sdc>(builder_128, config, keys, num_keys);
+                test_positions(builder_128, config, keys, num_keys, positions);
             }
         }
     }
@@ -8,7 +8,35 @@ void test_encoder(Builder const& builder, build_configuration const& config, Ite
     single_phf<typename Builder::hasher_type, Encoder, true> f;
     f.build(builder, config);
     testing::require_equal(f.num_keys(), num_keys);
-    check(keys, f);
+    testing::require_equal(check(keys, f), true);
+    testing::require_equal(check(keys, f, 4), true);
+}
+
+template <typename Builder, typename Iterator>
+void test_positions(Builder const& builder, build_configuration const& config, Iterator keys,
+                    uint64_t num_keys, std::vector<uint64_t> const& positions) {
+    single_phf<typename Builder::hasher_type, dictionary_dictionary, true> f;
+    f.build(builder, config);
+    for (uint64_t i = 0; i != num_keys; ++i) testing::require_equal(positions[i], f(keys[i]));
+    std::vector<uint64_t> bulk_positions(num_keys);
+    f.evaluate(keys, num_keys, bulk_positions.begin(), 2);
+    testing::require_equal(bulk_positions == positions, true);
+}
+
+template <typename Builder>
+void test_search_stats(Builder const& builder, uint64_t num_keys) {
+    auto const& stats = builder.search_stats();
+    uint64_t num_buckets = 0, num_trials = 0, num_bucket_keys = 0, num_pilots = 0;
+    for (uint64_t size = 0; size != stats.num_buckets_by_size.size(); ++size) {
+        num_buckets += stats.num_buckets_by_size[size];
+        num_trials += stats.num_trials_by_size[size];
+        num_bucket_keys += size * stats.num_buckets_by_size[size];
+    }
+    for (auto count : stats.pilots_histogram) num_pilots += count;
+    testing::require_equal(num_bucket_keys, num_keys);
+    testing::require_equal(num_buckets, stats.num_buckets);
+    testing::require_equal(num_pilots, stats.num_buckets);
+    testing::require_equal(num_trials, stats.num_trials);
 }
 
 template <typename Iterator>
@@ -21,8 +49,10 @@ void test_internal_memory_single_mphf(Iterator keys, uint64_t num_keys) {
     build_configuration config;
     config.minimal_output = true;  // mphf
     config.verbose_output = false;
+    config.search_statistics = true;
     config.seed = random_value();
 
+    std::vector<uint64_t> positions(num_keys);
     std::vector<double> C{4.0, 4.5, 5.0, 5.5, 6.0};
     std::vector<double> A{1.0, 0.99, 0.98, 0.97, 0.96};
     for (auto c : C) {
@@ -30,7 +60,7 @@ void test_internal_memory_single_mphf(Iterator keys, uint64_t num_keys) {
         for (auto alpha : A) {
             config.alpha = alpha;
 
-            builder_64.build_from_keys(keys, num_keys, config);
+            builder_64.build_from_keys(keys, num_keys, config, positions.begin());
             test_encoder<compact>(builder_64, config, keys, num_keys);
             test_encoder<partitioned_compact>(builder_64, config, keys, num_keys);
             test_encoder<compact_compact>(builder_64, config, keys, num_keys);
@@ -39,8 +69,10 @@ void test_internal_memory_single_mphf(Iterator keys, uint64_t num_keys) {
             test_encoder<elias_fano>(builder_64, config, keys, num_keys);
             test_encoder<dictionary_elias_fano>(builder_64, config, keys, num_keys);
             test_encoder<sdc>(builder_64, config, keys, num_keys);
+            test_positions(builder_64, config, keys, num_keys, positions);
+            test_search_stats(builder_64, num_keys);
 
-            builder_128.build_from_keys(keys, num_keys, config);
+            builder_128.build_from_keys(keys, num_keys, config, positions.begin());
             test_encoder<compact>(builder_128, config, keys, num_keys);
             test_encoder<partitioned_compact>(builder_128, config, keys, num_keys);
             test_encoder<compact_compact>(builder_128, config, keys, num_keys);
@@ -49,11 +81,95 @@ void test_internal_memory_single_mphf(Iterator keys, uint64_t num_keys) {
             test_encoder<elias_fano>(builder_128, config, keys, num_keys);
             test_encoder<dictionary_elias_fano>(builder_128, config, keys, num_keys);
             test_encoder<sdc>(builder_128, config, keys, num_keys);
+            test_positions(builder_128, config, keys, num_keys, positions);
+            test_search_stats(builder_128, num_keys);
         }
     }
 }
 
+void test_duplicate_keys() {
+    std::vector<uint64_t> keys = distinct_keys<uint64_t>(10000, random_value());
+    keys.push_back(keys[42]);
+    keys.insert(keys.begin() + 7, keys[5000]);
+    build_configuration config;
+    config.verbose_output = false;
+    internal_memory_builder_single_phf<murmurhash2_64> builder;
+    std::vector<std::pair<uint64_t, uint64_t>> duplicates;
+    try {
+        builder.build_from_keys(keys.begin(), keys.size(), config);
+    } catch (duplicate_keys_error const& e) {
+        duplicates = e.duplicates();
+    }
+    std::vector<std::pair<uint64_t, uint64_t>> expected = {{5001, 7}, {10001, 43}};
+    testing::require_equal(duplicates == expected, true);
+}
+
+/* Counts the I/O events, that only the external-memory builders report, and their bytes. */
+struct io_counter : telemetry_sink {
+    void io(build_phase phase, uint64_t bytes_read, uint64_t bytes_written) override {
+        ++num_events;
+        if (phase == build_phase::mapping_ordering) mapping_bytes_read += bytes_read;
+        total_bytes_read += bytes_read;
+        total_bytes_written += bytes_written;
+    }
+    uint64_t num_events = 0;
+    uint64_t mapping_bytes_read = 0;
+    uint64_t total_bytes_read = 0;
+    uint64_t total_bytes_written = 0;
+};
+
+void test_build() {
+    std::vector<uint64_t> keys = distinct_keys<uint64_t>(10000, random_value());
+    build_configuration config;
+    config.minimal_output = true;
+    config.verbose_output = false;
+    config.seed = random_value();
+    io_counter counter;
+    config.telemetry = &counter;
+    uint64_t num_bytes = internal_memory_builder_single_phf<
+        murmurhash2_64>::estimate_num_bytes_for_construction(keys.size(), config);
+
+    single_phf<murmurhash2_64, dictionary_dictionary, true> internal_f, external_f;
+    config.ram = num_bytes;
+    internal_f.build(keys.begin(), keys.size(), config);
+    testing::require_equal(counter.num_events, uint64_t(0));
+
+    config.ram = num_bytes - 1;
+    std::vector<uint64_t> positions(keys.size());
+    external_f.build(keys.begin(), keys.size(), config, positions.begin());
+    testing::require_equal(counter.num_events > 0, true);
+    /*
+        The mapping reads back the sorted pairs, 12 bytes per key. Every byte written
+        to a temporary file is read back, except those of the pilots and free slots.
+    */
+    uint64_t pairs_bytes = keys.size() * sizeof(bucket_payload_pair<narrow_bucket_id_type>);
+    testing::require_equal(counter.mapping_bytes_read, pairs_bytes);
+    uint64_t table_size = external_f.table_size();
+    uint64_t pilots_and_free_slots_bytes =
+        (compute_num_buckets(keys.size(), config) + table_size - keys.size()) * sizeof(uint64_t);
+    testing::require_equal(counter.total_bytes_written - counter.total_bytes_read,
+                           pilots_and_free_slots_bytes);
+    for (uint64_t i = 0; i != keys.size(); ++i) {
+        testing::require_equal(internal_f(keys[i]), positions[i]);
+        testing::require_equal(external_f(keys[i]), positions[i]);
+    }
+
+    /* single-pass keys are built in external memory, with the positions of the first pass */
+    std::stringstream lines;
+    for (auto key : keys) lines << key << '\n';
+    counter.num_events = 0;
+    config.ram = num_bytes;
+    single_phf<murmurhash2_64, dictionary_dictionary, true> lines_f;
+    lines_f.build(sequential_lines_iterator(lines), keys.size(), config, positions.begin());
+    testing::require_equal(counter.num_events > 0, true);
+    for (uint64_t i = 0; i != keys.size(); ++i) {
+        testing::require_equal(lines_f(std::to_string(keys[i])), positions[i]);
+    }
+}
+
 int main() {
+    test_duplicate_keys();
+    test_build();
     static const uint64_t universe = 100000;
     for (int i = 0; i != 5; ++i) {
         uint64_t num_keys = random_value() % universe;
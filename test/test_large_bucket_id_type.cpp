@@ -0,0 +1,64 @@
+/* As compiled with -DPTHASH_ENABLE_LARGE_BUCKET_ID_TYPE: all bucket ids are 64-bit. */
+#define PTHASH_ENABLE_LARGE_BUCKET_ID_TYPE
+
+#include "common.hpp"
+
+using namespace pthash;
+
+template <typename Function>
+void test_positions(Function const& f, std::vector<uint64_t> const& keys,
+                    std::vector<uint64_t> const& positions) {
+    testing::require_equal(f.num_keys(), uint64_t(keys.size()));
+    testing::require_equal(check(keys.begin(), f), true);
+    for (uint64_t i = 0; i != keys.size(); ++i) testing::require_equal(f(keys[i]), positions[i]);
+}
+
+template <typename Hasher>
+void test_large_bucket_id_type(std::vector<uint64_t> const& keys) {
+    typedef single_phf<Hasher, dictionary_dictionary, true> single_mphf_type;
+    typedef partitioned_phf<Hasher, dictionary_dictionary, true> partitioned_mphf_type;
+    uint64_t num_keys = keys.size();
+    std::cout << "testing on " << num_keys << " keys with "
+              << sizeof(typename Hasher::hash_type) * 8 << "-bit hashes..." << std::endl;
+
+    build_configuration config;
+    config.minimal_output = true;  // mphf
+    config.verbose_output = false;
+    config.seed = random_value();
+    config.num_partitions = 8;
+
+    std::vector<uint64_t> positions(num_keys);
+    {
+        single_mphf_type f;
+        f.build_in_internal_memory(keys.begin(), num_keys, config, positions.begin());
+        test_positions(f, keys, positions);
+    }
+    {
+        single_mphf_type f;
+        f.build_in_external_memory(keys.begin(), num_keys, config, positions.begin());
+        test_positions(f, keys, positions);
+    }
+    {
+        partitioned_mphf_type f;
+        f.build_in_internal_memory(keys.begin(), num_keys, config, positions.begin());
+        test_positions(f, keys, positions);
+    }
+    {
+        partitioned_mphf_type f;
+        f.build_in_external_memory(keys.begin(), num_keys, config, positions.begin());
+        test_positions(f, keys, positions);
+    }
+}
+
+int main() {
+    /* the (bucket id, payload) pairs take 16 bytes, so 128-bit hashes are partitioned as such */
+    static_assert(sizeof(narrow_bucket_id_type) == 8);
+    static_assert(sizeof(bucket_payload_pair<narrow_bucket_id_type>) == 16);
+    static_assert(!partition_entries<murmurhash2_128>::compact);
+    testing::require_equal(wide_bucket_ids(uint64_t(1) << 33), false);
+
+    std::vector<uint64_t> keys = distinct_keys<uint64_t>(200000, random_value());
+    test_large_bucket_id_type<murmurhash2_64>(keys);
+    test_large_bucket_id_type<murmurhash2_128>(keys);
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <cstdio>  // for std::remove
+
+#include "common.hpp"
+
+using namespace pthash;
+
+static std::string to_string(byte_range key) {
+    return std::string(reinterpret_cast<char const*>(key.begin), key.end - key.begin);
+}
+
+/* Write the lines to the file, the last one without '\n' unless trailing_newline. */
+static void write_lines(std::string const& filename, std::vector<std::string> const& lines,
+                        bool trailing_newline) {
+    std::ofstream out(filename.c_str(), std::ofstream::binary);
+    for (uint64_t i = 0; i != lines.size(); ++i) {
+        out << lines[i];
+        if (i + 1 != lines.size() or trailing_newline) out << '\n';
+    }
+}
+
+template <typename Iterator>
+void require_keys(Iterator begin, Iterator end, std::vector<std::string> const& expected) {
+    testing::require_equal(uint64_t(end - begin), uint64_t(expected.size()));
+    uint64_t i = 0;
+    for (Iterator it = begin; it != end; ++it, ++i) {
+        testing::require_equal(to_string(*it), expected[i]);       // sequential
+        testing::require_equal(to_string(begin[i]), expected[i]);  // random access
+        testing::require_equal(uint64_t((begin + i) - begin), i);
+    }
+}
+
+/* The first n lines of the files, read with num_threads threads. */
+void test_lines(std::vector<std::string> const& filenames,
+                std::vector<std::string> const& lines, uint64_t num_threads) {
+    for (uint64_t n : {lines.size(), lines.size() / 2, uint64_t(1)}) {
+        mapped_string_collection keys(filenames, n, num_threads, false);
+        std::vector<std::string> expected(lines.begin(), lines.begin() + n);
+        testing::require_equal(keys.size(), n);
+        require_keys(keys.begin(), keys.end(), expected);
+    }
+    /* asking for more lines than the files have gives all the lines */
+    mapped_string_collection keys(filenames, lines.size() + 10, num_threads, false);
+    require_keys(keys.begin(), keys.end(), lines);
+}
+
+int main() {
+    std::string prefix = constants::default_tmp_dirname + "/pthash.temp.test_mapped.";
+    std::vector<uint64_t> values = distinct_keys<uint64_t>(10000, random_value());
+    std::vector<std::string> lines;
+    for (auto value : values) lines.push_back(std::to_string(value));
+    lines[1234] = "";  // a single empty key is allowed
+
+    for (bool trailing_newline : {true, false}) {
+        std::cout << "testing a single file "
+                  << (trailing_newline ? "with" : "without") << " a trailing newline..."
+                  << std::endl;
+        write_lines(prefix + "0", lines, trailing_newline);
+        for (uint64_t num_threads : {1, 4}) test_lines({prefix + "0"}, lines, num_threads);
+    }
+
+    /* shards, an empty one among them, each without a trailing newline */
+    std::cout << "testing several files..." << std::endl;
+    std::vector<std::string> filenames;
+    for (uint64_t i = 0, begin = 0; i != 5; ++i) {
+        uint64_t end = i == 2 ? begin : std::min<uint64_t>(begin + 2500, lines.size());
+        filenames.push_back(prefix + std::to_string(i));
+        write_lines(filenames.back(),
+                    std::vector<std::string>(lines.begin() + begin, lines.begin() + end), false);
+        begin = end;
+    }
+    for (uint64_t num_threads : {1, 2, 8}) test_lines(filenames, lines, num_threads);
+
+    /* dropping keys splits the shards around them */
+    std::cout << "testing drop..." << std::endl;
+    {
+        mapped_string_collection keys(filenames, lines.size(), 2, false);
+        std::vector<uint64_t> indices = {0, 2499, 2500, 5001, 9999};
+        keys.drop(indices);
+        std::vector<std::string> expected = lines;
+        drop(expected, indices);
+        require_keys(keys.begin(), keys.end(), expected);
+    }
+
+    /* the keys are built as they are, without copies */
+    std::cout << "testing a build..." << std::endl;
+    {
+        mapped_string_collection keys(filenames, lines.size(), 2, false);
+        build_configuration config;
+        config.minimal_output = true;  // mphf
+        config.verbose_output = false;
+        single_phf<murmurhash2_64, dictionary_dictionary, true> f;
+        f.build_in_internal_memory(keys.begin(), keys.size(), config);
+        testing::require_equal(check(keys.begin(), f), true);
+        for (uint64_t i = 0; i != lines.size(); ++i) {
+            testing::require_equal(f(keys.begin()[i]), f(lines[i]));
+        }
+    }
+
+    for (uint64_t i = 0; i != filenames.size(); ++i) std::remove(filenames[i].c_str());
+    return 0;
+}
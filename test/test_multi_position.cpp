@@ -0,0 +1,78 @@
+#include "common.hpp"
+
+using namespace pthash;
+
+typedef single_phf<murmurhash2_64, dictionary_dictionary, true> single_mphf_type;
+typedef partitioned_phf<murmurhash2_64, dictionary_dictionary, true> partitioned_mphf_type;
+
+template <typename Function>
+void test_against_single_build(Function const& f, std::vector<uint64_t> const& keys,
+                               build_configuration const& config) {
+    Function g;  // built on its own, with the shared seed
+    g.build_in_internal_memory(keys.begin(), keys.size(), config);
+    testing::require_equal(g.seed(), f.seed());
+    for (auto const& key : keys) testing::require_equal(f(key), g(key));
+}
+
+void test_multi_position(std::vector<uint64_t> const& keys) {
+    std::cout << "testing on " << keys.size() << " keys..." << std::endl;
+
+    /* the first function is built on all the keys, the second on half of them */
+    std::vector<uint64_t> half_keys(keys.begin(), keys.begin() + keys.size() / 2);
+
+    build_configuration config;
+    config.minimal_output = true;  // mphf
+    config.verbose_output = false;
+    config.num_partitions = 4;
+
+    single_mphf_type f1;
+    partitioned_mphf_type f2;
+    uint64_t seed = build_with_shared_seed(
+        [&](build_configuration const& c) {
+            f1.build_in_internal_memory(keys.begin(), keys.size(), c);
+            f2.build_in_internal_memory(half_keys.begin(), half_keys.size(), c);
+        },
+        config);
+    testing::require_equal(f1.seed(), seed);
+    testing::require_equal(f2.seed(), seed);
+
+    config.seed = seed;
+    test_against_single_build(f1, keys, config);
+    test_against_single_build(f2, half_keys, config);
+
+    for (auto const& key : half_keys) {
+        auto hash = murmurhash2_64::hash(key, seed);
+        auto positions = multi_position(hash, f1, f2);
+        testing::require_equal(positions[0], f1(key));
+        testing::require_equal(positions[1], f2(key));
+        testing::require_equal(multi_lookup(key, f1, f2) == positions, true);
+    }
+
+    /* with the seed set, a failing build is not retried */
+    bool thrown = false;
+    try {
+        build_with_shared_seed([](build_configuration const&) { throw seed_runtime_error(); },
+                               config);
+    } catch (seed_runtime_error const&) {
+        thrown = true;
+    }
+    testing::require_equal(thrown, true);
+
+    /* otherwise, the seeds that do not work are skipped */
+    config.seed = constants::invalid_seed;
+    uint64_t attempts = 0;
+    build_with_shared_seed(
+        [&](build_configuration const&) {
+            if (++attempts < 3) throw seed_runtime_error();
+        },
+        config);
+    testing::require_equal(attempts, uint64_t(3));
+}
+
+int main() {
+    for (uint64_t num_keys : {100000, 1000000}) {
+        std::vector<uint64_t> keys = distinct_keys<uint64_t>(num_keys, random_value());
+        test_multi_position(keys);
+    }
+    return 0;
+}
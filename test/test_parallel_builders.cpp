@@ -0,0 +1,86 @@
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "common.hpp"
+
+using namespace pthash;
+
+/* Every index of [0, n) is in exactly one non-empty range, each run by its own thread. */
+void test_parallel_ranges(uint64_t n, uint64_t num_threads) {
+    std::mutex mutex;
+    std::vector<uint64_t> covered(n, 0);
+    std::set<uint64_t> ids;
+    std::set<std::thread::id> thread_ids;
+    parallel_ranges(n, num_threads, [&](uint64_t t, uint64_t begin, uint64_t end) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (n != 0) testing::require_equal(begin < end, true);
+        for (; begin != end; ++begin) ++covered[begin];
+        ids.insert(t);
+        thread_ids.insert(std::this_thread::get_id());
+    });
+    uint64_t expected_threads = std::max<uint64_t>(std::min(num_threads, n), 1);
+    testing::require_equal(uint64_t(ids.size()), expected_threads);
+    testing::require_equal(uint64_t(thread_ids.size()), expected_threads);
+    for (auto c : covered) testing::require_equal(c, uint64_t(1));
+}
+
+/* Fewer partitions than threads: each partition is built and encoded by its own thread. */
+void test_few_partitions(std::vector<uint64_t> const& keys) {
+    typedef partitioned_phf<murmurhash2_64, dictionary_dictionary, true> mphf_type;
+    uint64_t num_keys = keys.size();
+
+    build_configuration config;
+    config.minimal_output = true;  // mphf
+    config.verbose_output = false;
+    config.seed = random_value();
+    config.num_partitions = 3;
+
+    mphf_type expected;
+    std::vector<uint64_t> expected_positions(num_keys);
+    config.num_threads = 1;
+    expected.build_in_internal_memory(keys.begin(), num_keys, config, expected_positions.begin());
+
+    for (uint64_t num_threads : {4, 8}) {
+        std::cout << "testing " << config.num_partitions << " partitions with " << num_threads
+                  << " threads..." << std::endl;
+        config.num_threads = num_threads;
+        mphf_type f;
+        std::vector<uint64_t> positions(num_keys);
+        f.build_in_internal_memory(keys.begin(), num_keys, config, positions.begin());
+        testing::require_equal(positions == expected_positions, true);
+        for (uint64_t i = 0; i != num_keys; ++i) {
+            testing::require_equal(f(keys[i]), expected_positions[i]);
+        }
+        testing::require_equal(check(keys.begin(), f), true);
+    }
+}
+
+/* The keys hashed by num_threads threads, in rounds, are consumed as with a single thread. */
+void test_transform_hashes(std::vector<uint64_t> const& keys) {
+    typedef hash_generator<std::vector<uint64_t>::const_iterator, murmurhash2_128> generator_type;
+    uint64_t seed = random_value();
+    auto mix = [](murmurhash2_128::hash_type const& hash) { return hash.mix(); };
+    std::vector<uint64_t> expected;
+    transform_hashes(generator_type(keys.begin(), seed), keys.size(), 1, mix,
+                     [&](uint64_t value) { expected.push_back(value); });
+    testing::require_equal(uint64_t(expected.size()), uint64_t(keys.size()));
+    for (uint64_t num_threads : {2, 3, 8}) {
+        std::cout << "testing transform_hashes with " << num_threads << " threads..."
+                  << std::endl;
+        std::vector<uint64_t> values;
+        transform_hashes(generator_type(keys.begin(), seed), keys.size(), num_threads, mix,
+                         [&](uint64_t value) { values.push_back(value); });
+        testing::require_equal(values == expected, true);
+    }
+}
+
+int main() {
+    for (uint64_t n : {0, 1, 2, 3, 5, 8, 1000}) {
+        for (uint64_t num_threads : {1, 2, 4, 8}) test_parallel_ranges(n, num_threads);
+    }
+    std::vector<uint64_t> keys = distinct_keys<uint64_t>(300000, random_value());
+    test_few_partitions(keys);
+    test_transform_hashes(keys);
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <sstream>
+#include <thread>
+
+#include "common.hpp"
+
+using namespace pthash;
+
+/* Run f with std::cout redirected and return what it printed. */
+template <typename Function>
+std::string printed(Function f) {
+    std::stringstream ss;
+    auto buf = std::cout.rdbuf(ss.rdbuf());
+    f();
+    std::cout.rdbuf(buf);
+    return ss.str();
+}
+
+int main() {
+    static const uint64_t total_events = 3 * progress_logger::batch_size + 7;
+    static const uint64_t half = total_events / 2;
+
+    std::string output = printed([]() {
+        progress_logger logger(total_events, "logged ", " events", true,
+                               std::chrono::milliseconds(1));
+        for (uint64_t i = 0; i != half; ++i) logger.log();
+        testing::require_equal(logger.logged_events(), half);
+        /* the next tick prints the events flushed so far (whole batches), with the ETA */
+        uint64_t num_ticks = logger.num_ticks();
+        while (logger.num_ticks() == num_ticks) std::this_thread::yield();
+        for (uint64_t i = half; i != total_events; ++i) logger.log();
+        logger.finalize();
+        testing::require_equal(logger.logged_events(), total_events);
+    });
+    std::cout << output << std::endl;
+    uint64_t batch_perc = 100 * progress_logger::batch_size / total_events;
+    testing::require_equal(output.find("\rlogged 0% events") == 0, true);
+    testing::require_equal(
+        output.find("\rlogged " + std::to_string(batch_perc) + "% events (ETA ") !=
+            std::string::npos,
+        true);
+    testing::require_equal(output.find("\rlogged 100% events") != std::string::npos, true);
+    testing::require_equal(output.back(), '\n');
+
+    /* a disabled logger counts the events but prints nothing */
+    output = printed([]() {
+        progress_logger logger(total_events, "logged ", " events", false);
+        for (uint64_t i = 0; i != total_events; ++i) logger.log();
+        logger.finalize();
+        testing::require_equal(logger.logged_events(), total_events);
+    });
+    testing::require_equal(output.empty(), true);
+
+    /* several threads log into the same logger */
+    for (uint64_t num_threads : {2, 4, 7}) {
+        output = printed([num_threads]() {
+            progress_logger logger(total_events, "logged ", " events", true,
+                                   std::chrono::milliseconds(1));
+            parallel_ranges(total_events, num_threads, [&](uint64_t, uint64_t begin, uint64_t end) {
+                for (; begin != end; ++begin) logger.log();
+            });
+            testing::require_equal(logger.logged_events(), total_events);
+            logger.finalize();
+            testing::require_equal(logger.logged_events(), total_events);
+        });
+        testing::require_equal(output.find("\rlogged 100% events") != std::string::npos, true);
+    }
+
+    return 0;
+}